@@ -0,0 +1,264 @@
+#pragma once
+#include "node.hpp"
+#include "utf8.hpp"
+
+// What every kind of node does, written once against callables that evaluate
+// the children of the node. Node::eval() runs them over the tree of objects,
+// Program::eval() over the flat node table of a compiled pattern file, so the
+// two can never disagree on what a pattern matches
+
+template<typename EvalAt>
+bool evalPlane(size_t size, EvalAt evalAt) {
+ALGO_START:
+	auto old = state.resEnd;
+	bool res = evalAt(0);
+	while(!res && state.strEnd != state.resEnd && state.resBegin < state.strEnd) {
+		state.resEnd = ++state.resBegin;
+		res = evalAt(0);
+	}
+	auto multiplePlaneCheck = state.resBegin;
+
+	for(size_t i = 1; i < size && res; i++) {
+		if(state.wasGreedy) {
+			state.wasGreedy = false;
+			auto back = state.strEnd;
+			state.resEnd = back;
+			res = evalAt(i);
+			while(!res && old < back) {
+				state.resEnd = --back;
+				res = evalAt(i);
+			}
+			if(!res) {
+				state.resEnd = state.resBegin = state.strEnd;
+				return false;
+			}
+			if(state.lastGrouping < state.groupings.size() ) {
+				state.groupings[state.lastGrouping].last = back;
+			}
+			old = state.resEnd;
+		} else {
+			old = state.resEnd;
+			res = evalAt(i);
+		}
+
+	}
+
+	// Retry from the position after the one the first node matched at,
+	// resuming from resEnd would skip the candidates in between
+	if(!res && state.resBegin != state.strEnd) {
+		state.resEnd = ++state.resBegin;
+		goto ALGO_START;
+	}
+
+	if(multiplePlaneCheck != state.resBegin) {
+		return false;
+	}
+
+	// Cutoff error fix
+	if(!res) {
+		state.resBegin = state.strEnd;
+	}
+	return res;
+}
+
+template<typename EvalChild>
+bool evalSelectionGroup(int value, EvalChild evalChild) {
+	bool res = evalChild();
+	if(res && value > 0 && state.captures && static_cast<size_t>(value) <= state.groupings.size() ) {
+		state.resBegin = state.groupings[value - 1].first;
+		state.resEnd = state.groupings[value - 1].last;
+	} else if(!res) {
+		state.resBegin = state.resEnd = state.strEnd;
+	}
+	return res;
+}
+
+template<typename EvalChild>
+bool evalGrouping(int index, EvalChild evalChild) {
+	if(!state.captures) {
+		return evalChild();
+	}
+	auto start = state.resEnd;
+	bool res = evalChild();
+	state.groupings[index] = res ? Span{start, state.resEnd}
+		: Span{state.strEnd, state.strEnd};
+	state.lastGrouping = index;
+	return res;
+}
+
+template<typename EvalChild>
+bool evalCaseInsensitive(EvalChild evalChild) {
+	state.caseInsDepth++;
+	bool result = evalChild();
+	state.caseInsDepth--;
+	return result;
+}
+
+template<typename EvalChild>
+bool evalRepeated(EvalChild evalChild) {
+	state.cameFromWildcard = false;
+	bool result = evalChild();
+	if(!result) {
+		return false;
+	}
+	// A child that matched nothing at the start of the subject leaves no
+	// byte to repeat, the one before the subject is not part of it
+	if(state.resEnd == state.strBegin) {
+		return true;
+	}
+	auto prev = std::prev(state.resEnd);
+	if(state.utf8) {
+		// The unit repeated is the last code point rather than the last byte
+		auto unit = prev;
+		while(unit != state.strBegin && isUtf8Continuation(*unit) ) {
+			unit--;
+		}
+		const auto size = state.resEnd - unit;
+		auto repeats = [&] {
+			return state.strEnd - state.resEnd >= size && std::equal(unit, unit + size, state.resEnd);
+		};
+		if(repeats() ) {
+			while(repeats() ) {
+				state.resEnd += size;
+			}
+			return true;
+		}
+	} else if(*state.resEnd == *prev) {
+		while(state.resEnd < state.strEnd && *state.resEnd == *prev) {
+			state.resEnd++;
+		}
+		return true;
+	}
+	if(state.cameFromWildcard) {
+		state.cameFromWildcard = false;
+		state.wasGreedy = true;
+		state.resEnd = state.strEnd;
+	}
+	return true;
+}
+
+// Picks the outcome of a+b from the outcomes of a and b, state is left as the
+// one picked
+inline bool chooseAlternative(bool lhsSuccess, const State &lhsState, bool rhsSuccess, const State &rhsState) {
+	if(!lhsSuccess && !rhsSuccess) {
+		state = rhsState.resEnd < lhsState.resEnd ? rhsState : lhsState;
+		return false;
+	} else if(lhsSuccess && !rhsSuccess) {
+		state = lhsState;
+		return true;
+	} else if(!lhsSuccess && rhsSuccess) {
+		state = rhsState;
+		return true;
+	}
+
+	// Both suceeded, find out which one progressed the furthest
+	state = rhsState.resBegin <= lhsState.resBegin ? rhsState : lhsState;
+	return true;
+}
+
+// An either holds the alternatives of a chain a+b+c, which matches what
+// a+(b+c) does: the right hand side of every + but the last is a sequence of
+// its own, and like any sequence it tries later starts when the either in it
+// fails. The levels of that nesting are kept in frames rather than on the
+// call stack, so that the length of a chain does not bound it
+template<typename EvalAt>
+bool evalEither(size_t size, EvalAt evalAt) {
+	struct Frame {
+		State save;
+		State lhsState;
+		bool lhsSuccess;
+	};
+	std::vector<Frame> frames;
+	for(;;) {
+		// Level frames.size() evaluates its own alternative and, for all
+		// but the last level, searches the levels below it from state on
+		Frame frame{state, State(), false};
+		frame.lhsSuccess = evalAt(frames.size() );
+		frame.lhsState = state;
+		state = frame.save;
+		if(frames.size() + 2 < size) {
+			frames.push_back(std::move(frame) );
+			continue;
+		}
+		bool rhsSuccess = evalAt(size - 1);
+		bool result = chooseAlternative(frame.lhsSuccess, frame.lhsState, rhsSuccess, State(state) );
+
+		// Hands the outcome of each level to the sequence around it
+		for(; !frames.empty(); frames.pop_back() ) {
+			if(!result && state.resBegin != state.strEnd) {
+				state.resEnd = ++state.resBegin;
+				break;
+			}
+			if(!result) {
+				state.resBegin = state.strEnd;
+			}
+			result = chooseAlternative(frames.back().lhsSuccess, frames.back().lhsState, result, State(state) );
+		}
+		if(frames.empty() ) {
+			return result;
+		}
+	}
+}
+
+template<typename EvalChild>
+bool evalCounter(int value, EvalChild evalChild) {
+	if(std::distance(state.resEnd, state.strEnd) < value) {
+		return false;
+	}
+	for(int i = 0; i < value; i++) {
+		if(!evalChild() ) {
+			return false;
+		}
+	}
+	return true;
+}
+
+// Under \I in UTF-8 mode code points are compared by their simple case
+// folding, a code point and its folding may differ in length
+inline bool evalFoldedString(const char *value, size_t length) {
+	const char *it = value, *last = value + length;
+	char32_t expected, actual;
+	while(decodeUtf8(it, last, expected) ) {
+		if(!decodeUtf8(state.resEnd, state.strEnd, actual) || foldCase(actual) != foldCase(expected) ) {
+			return false;
+		}
+	}
+	return it == last;
+}
+
+inline bool evalString(const char *value, size_t length) {
+	if(state.utf8 && state.caseInsDepth > 0) {
+		return evalFoldedString(value, length);
+	}
+	for(size_t i = 0; i < length; i++) {
+		const char c = value[i];
+		const bool isUpper = state.caseInsDepth == 0;
+		if(isUpper) {
+			if(state.resEnd == state.strEnd || *state.resEnd != c) {
+				return false;
+			}
+		} else if(std::toupper(*state.resEnd) != std::toupper(c)) {
+			return false;
+		}
+		state.resEnd++;
+	}
+	return true;
+}
+
+inline bool evalWildcard() {
+	if(state.resEnd == state.strEnd) {
+		return false;
+	}
+	if(state.utf8) {
+		// Matches a whole code point, never starts in the middle of one
+		const size_t length = utf8Length(*state.resEnd);
+		if(length == 0 || static_cast<size_t>(state.strEnd - state.resEnd) < length) {
+			return false;
+		}
+		state.resEnd += length;
+	} else {
+		state.resEnd++;
+	}
+	state.cameFromWildcard = true;
+	return true;
+}
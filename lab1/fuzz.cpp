@@ -0,0 +1,220 @@
+#include "fuzz.hpp"
+#include "incremental.hpp"
+#include "matcher.hpp"
+
+#include <random>
+
+namespace {
+
+// Pieces that are mostly well formed on their own, so that most generated
+// patterns parse, over the same few letters as the subjects. U+017F and the
+// Kelvin sign fold to s and k in UTF-8 mode, the bytes of \xC3\xA9 are above
+// 0x7F and end up as the anchor of native code
+constexpr std::array<std::string_view, 19> atoms = {
+	"a", "b", "ab", "ba", "abc", ".", "\\I", "(ab)", "(a.)", "{2}", "{0}", 
+	"*", "(a+b)", "(.)", "c", "Ab", "\xC5\xBF\\I", "\xE2\x84\xAAs\\I", "\xC3\xA9"
+};
+
+// Whole code points, so that every subject is valid UTF-8
+constexpr std::array<std::string_view, 8> letters = {"a", "b", "c", "k", "s", "A", "B", "\xC3\xA9"};
+
+struct Outcome {
+	std::vector<std::pair<long, long>> matches;
+	std::vector<std::pair<long, long>> selections;
+
+	bool operator==(const Outcome &other) const {
+		return matches == other.matches && selections == other.selections;
+	}
+};
+
+// decode has the subject matched by code point even when it is all ASCII
+Outcome run(Matcher &matcher, const std::string &subject, bool decode = false) {
+	Outcome outcome;
+	Span match, selected;
+	Iterator it = subject.cbegin();
+	decode |= matcher.decodes(subject.cbegin(), subject.cend() );
+	// Mirrors MatchPrinter::line(), a bounded number of matches is enough
+	for(int i = 0; i < 16 && matcher.find(it, subject.cend(), match, decode); i++) {
+		outcome.matches.emplace_back(match.first - subject.cbegin(), match.last - subject.cbegin() );
+		if(matcher.select(match, selected) ) {
+			outcome.selections.emplace_back(selected.first - subject.cbegin(), 
+				selected.last - subject.cbegin() );
+		}
+		if(!Matcher::resume(it, match, subject.cend() ) ) {
+			break;
+		}
+	}
+	return outcome;
+}
+
+std::string randomPattern(std::mt19937 &random) {
+	std::string pattern;
+	for(size_t i = random() % 5 + 1; i > 0; i--) {
+		pattern += atoms[random() % atoms.size()];
+	}
+	if(random() % 8 == 0) {
+		pattern += "\\O{1}";
+	}
+	return pattern;
+}
+
+std::unique_ptr<Matcher> compile(const std::string &pattern) {
+	Tokenizer tokenizer;
+	Parser parser;
+	Child root = parser.parseTokens(tokenizer.tokenize(pattern) );
+	if(!root) {
+		return nullptr;
+	}
+	return std::make_unique<Matcher>(std::move(root), parser.groups() );
+}
+
+std::string randomText(std::mt19937 &random, size_t longest) {
+	std::string text;
+	for(size_t i = random() % (longest + 1); i > 0; i--) {
+		text += letters[random() % letters.size()];
+	}
+	return text;
+}
+
+void print(std::ostream &os, const std::vector<MatchRange> &matches) {
+	for(const MatchRange &range : matches) {
+		os << ' ' << range.first << '-' << range.last;
+		if(range.selected) {
+			os << '/' << range.selectedFirst << '-' << range.selectedLast;
+		}
+	}
+}
+
+void print(std::ostream &os, const Outcome &outcome) {
+	for(auto [first, last] : outcome.matches) {
+		os << ' ' << first << '-' << last;
+	}
+	os << " /";
+	for(auto [first, last] : outcome.selections) {
+		os << ' ' << first << '-' << last;
+	}
+}
+
+}
+
+size_t fuzzEngines(size_t count, unsigned seed) {
+	std::mt19937 random(seed);
+	constexpr std::array<Engine, 3> engines = {Engine::Literal, Engine::ShiftAnd, Engine::Jit};
+	size_t patterns = 0, comparisons = 0, mismatches = 0, utf8Compared = 0;
+	std::array<size_t, 4> compared{};
+
+	while(patterns < count) {
+		std::string pattern = randomPattern(random);
+		auto reference = compile(pattern);
+		if(!reference) {
+			continue;
+		}
+		reference->use(Engine::Backtrack);
+		patterns++;
+
+		std::vector<std::string> subjects(8);
+		for(auto &subject : subjects) {
+			// Some subjects are long enough for the engines that take 16
+			// starts at a time
+			for(size_t i = random() % (random() % 4 ? 20 : 100); i > 0; i--) {
+				subject += letters[random() % letters.size()];
+			}
+		}
+
+		for(Engine engine : engines) {
+			auto candidate = compile(pattern);
+			if(!candidate->use(engine) ) {
+				continue;
+			}
+			compared[static_cast<size_t>(engine)]++;
+			for(auto &subject : subjects) {
+				comparisons++;
+				Outcome expected = run(*reference, subject);
+				Outcome actual = run(*candidate, subject);
+				if(expected == actual) {
+					continue;
+				}
+				mismatches++;
+				std::cerr << engineName(engine) << " differs on " << pattern << " | " << subject << "\n  backtrack:";
+				print(std::cerr, expected);
+				std::cerr << "\n  " << engineName(engine) << ':';
+				print(std::cerr, actual);
+				std::cerr << '\n';
+			}
+		}
+
+		// In UTF-8 mode an ASCII subject is left to the engine planned for
+		// bytes, which has to find what decoding it finds
+		auto utf8 = compile(pattern);
+		auto decoding = compile(pattern);
+		utf8->setUtf8(true);
+		decoding->setUtf8(true);
+		decoding->use(Engine::Backtrack);
+		utf8Compared++;
+		for(auto &subject : subjects) {
+			comparisons++;
+			Outcome expected = run(*decoding, subject, true);
+			Outcome actual = run(*utf8, subject);
+			if(expected == actual) {
+				continue;
+			}
+			mismatches++;
+			std::cerr << "UTF-8 " << engineName(utf8->engine() ) << " differs on " << pattern << " | "
+				<< subject << "\n  decoded:";
+			print(std::cerr, expected);
+			std::cerr << "\n  " << engineName(utf8->engine() ) << ':';
+			print(std::cerr, actual);
+			std::cerr << '\n';
+		}
+	}
+
+	std::cerr << patterns << " patterns, " << comparisons << " comparisons, " << mismatches << " mismatches\n";
+	for(Engine engine : engines) {
+		std::cerr << "  " << engineName(engine) << ": " << compared[static_cast<size_t>(engine)] << " patterns\n";
+	}
+	std::cerr << "  utf-8: " << utf8Compared << " patterns\n";
+	return mismatches;
+}
+
+size_t fuzzEdits(size_t count, unsigned seed) {
+	std::mt19937 random(seed);
+	size_t patterns = 0, edits = 0, mismatches = 0, scanned = 0, length = 0;
+
+	while(patterns < count) {
+		std::string pattern = randomPattern(random);
+		auto matcher = compile(pattern);
+		if(!matcher) {
+			continue;
+		}
+		patterns++;
+
+		IncrementalMatcher incremental(*matcher, randomText(random, 200) );
+		for(int i = 0; i < 16; i++) {
+			const size_t size = incremental.text().size();
+			const size_t offset = random() % (size + 1);
+			const size_t removed = random() % 4 ? random() % 3 : random() % (size - offset + 1);
+			const std::string before = incremental.text();
+			incremental.edit(offset, removed, randomText(random, 3) );
+			edits++;
+			scanned += incremental.rescanned();
+			length += incremental.text().size();
+
+			IncrementalMatcher reference(*matcher, incremental.text() );
+			if(reference.matches() == incremental.matches() ) {
+				continue;
+			}
+			mismatches++;
+			std::cerr << "Edit differs on " << pattern << " | " << before << " -> " 
+				<< incremental.text() << "\n  whole text:";
+			print(std::cerr, reference.matches() );
+			std::cerr << "\n  incremental:";
+			print(std::cerr, incremental.matches() );
+			std::cerr << '\n';
+			break;
+		}
+	}
+
+	std::cerr << patterns << " patterns, " << edits << " edits, " << mismatches << " mismatches, "
+		<< scanned << " of " << length << " bytes searched again\n";
+	return mismatches;
+}
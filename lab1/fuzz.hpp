@@ -0,0 +1,14 @@
+#pragma once
+#include <cstddef>
+
+// Differential fuzzer. Generates count random patterns and subjects and
+// checks that every engine eligible for a pattern finds and selects the same
+// spans as the backtracker, and that in UTF-8 mode the engine planned finds
+// in ASCII subjects what decoding them finds. Mismatches are written to
+// stderr, returns how many there were
+size_t fuzzEngines(size_t count, unsigned seed);
+
+// Checks IncrementalMatcher against scanning the whole text again after each
+// of a series of random edits to the text of count random patterns. Returns
+// the number of mismatches
+size_t fuzzEdits(size_t count, unsigned seed);
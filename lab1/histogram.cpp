@@ -0,0 +1,84 @@
+#include "histogram.hpp"
+
+#include <algorithm>
+#include <string>
+
+namespace {
+
+uint64_t nanoseconds(Clock::duration duration) {
+	return std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+}
+
+// 1500 ns as 1.5us, with the unit that keeps it below a thousand
+std::string readable(uint64_t ns) {
+	constexpr const char *units[] = {"ns", "us", "ms", "s"};
+	double value = ns;
+	size_t unit = 0;
+	while(value >= 1000 && unit + 1 < std::size(units) ) {
+		value /= 1000;
+		unit++;
+	}
+	std::string text = std::to_string(value);
+	text.erase(text.find('.') + (value < 10 ? 2 : 0) );
+	return text + units[unit];
+}
+
+}
+
+void LatencyHistogram::record(Clock::duration latency) {
+	const uint64_t ns = nanoseconds(latency);
+	size_t bucket = 0;
+	while(bucket + 1 < buckets.size() && ns >> bucket) {
+		bucket++;
+	}
+	buckets[bucket]++;
+	total++;
+	sum += latency;
+	max = std::max(max, latency);
+}
+
+void LatencyHistogram::merge(const LatencyHistogram &other) {
+	for(size_t i = 0; i < buckets.size(); i++) {
+		buckets[i] += other.buckets[i];
+	}
+	total += other.total;
+	sum += other.sum;
+	max = std::max(max, other.max);
+}
+
+Clock::duration LatencyHistogram::percentile(double fraction) const {
+	const uint64_t rank = static_cast<uint64_t>(fraction * total);
+	uint64_t seen = 0;
+	for(size_t i = 0; i < buckets.size(); i++) {
+		seen += buckets[i];
+		if(seen > rank) {
+			return std::min<Clock::duration>(std::chrono::nanoseconds(uint64_t(1) << i), max);
+		}
+	}
+	return max;
+}
+
+std::ostream &operator<<(std::ostream &os, const LatencyHistogram &histogram) {
+	if(histogram.total == 0) {
+		return os << "no latencies recorded\n";
+	}
+	os << "mean " << readable(nanoseconds(histogram.sum) / histogram.total)
+		<< ", p50 " << readable(nanoseconds(histogram.percentile(0.5) ) )
+		<< ", p90 " << readable(nanoseconds(histogram.percentile(0.9) ) )
+		<< ", p99 " << readable(nanoseconds(histogram.percentile(0.99) ) )
+		<< ", max " << readable(nanoseconds(histogram.max) ) << '\n';
+
+	const uint64_t widest = *std::max_element(histogram.buckets.begin(), histogram.buckets.end() );
+	for(size_t i = 0; i < histogram.buckets.size(); i++) {
+		const uint64_t count = histogram.buckets[i];
+		if(count == 0) {
+			continue;
+		}
+		std::string bound = "< " + readable(uint64_t(1) << i);
+		bound.resize(std::max<size_t>(bound.size(), 10), ' ');
+		std::string counted = std::to_string(count);
+		counted.insert(0, counted.size() < 10 ? 10 - counted.size() : 0, ' ');
+		os << "  " << bound << counted << ' ' << std::string(40 * count / widest, '#') << '\n';
+	}
+	return os;
+}
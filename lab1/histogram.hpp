@@ -0,0 +1,27 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <ostream>
+
+using Clock = std::chrono::steady_clock;
+
+// Latencies counted in buckets of powers of two nanoseconds, bucket i holds
+// those below 2^i ns. Cheap enough to record every request
+class LatencyHistogram {
+public:
+	void record(Clock::duration latency);
+	void merge(const LatencyHistogram &other);
+
+	uint64_t count() const { return total; }
+	// Upper bound of the bucket the latency at fraction of the count is in
+	Clock::duration percentile(double fraction) const;
+
+	// Mean, percentiles and a bar for every bucket that is not empty
+	friend std::ostream &operator<<(std::ostream &os, const LatencyHistogram &histogram);
+private:
+	std::array<uint64_t, 64> buckets = {};
+	uint64_t total = 0;
+	Clock::duration sum = Clock::duration::zero();
+	Clock::duration max = Clock::duration::zero();
+};
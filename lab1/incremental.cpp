@@ -0,0 +1,95 @@
+#include "incremental.hpp"
+
+namespace {
+
+size_t reachOf(const PatternProperties &properties) {
+	if(properties.maxLength > unbounded - properties.largestCount) {
+		return unbounded;
+	}
+	return properties.maxLength + properties.largestCount;
+}
+
+}
+
+IncrementalMatcher::IncrementalMatcher(Matcher &matcher, std::string text)
+	: matcher(matcher), subject(std::move(text) ), reach(reachOf(matcher.plan().properties) ) {
+	for(size_t from = 0; search(from); from = next(found.size() - 1) ) {
+	}
+	scanned = subject.size();
+}
+
+size_t IncrementalMatcher::next(size_t i) const {
+	Iterator from = subject.cbegin() + starts[i];
+	const Span match{subject.cbegin() + found[i].first, subject.cbegin() + found[i].last};
+	if(!Matcher::resume(from, match, subject.cend() ) ) {
+		return subject.size() + 1;
+	}
+	return from - subject.cbegin();
+}
+
+bool IncrementalMatcher::search(size_t from) {
+	Span match, selected;
+	if(from > subject.size() || !matcher.find(subject.cbegin() + from, subject.cend(), match) ) {
+		return false;
+	}
+	const bool selects = matcher.select(match, selected);
+	auto offset = [this](Iterator it) { return static_cast<size_t>(it - subject.cbegin() ); };
+	found.push_back(MatchRange{offset(match.first), offset(match.last),
+		selects ? offset(selected.first) : 0, selects ? offset(selected.last) : 0, selects});
+	starts.push_back(from);
+	return true;
+}
+
+void IncrementalMatcher::edit(size_t offset, size_t length, std::string_view replacement) {
+	offset = std::min(offset, subject.size() );
+	length = std::min(length, subject.size() - offset);
+
+	size_t kept = 0;
+	if(reach != unbounded) {
+		while(kept < found.size() && found[kept].first + reach <= offset) {
+			kept++;
+		}
+	}
+	const size_t resumed = kept ? next(kept - 1) : 0;
+	// The search starts of the old scan from there on, the last one found
+	// nothing
+	std::vector<size_t> oldStarts(starts.begin() + kept, starts.end() );
+	oldStarts.push_back(found.size() > kept ? next(found.size() - 1) : resumed);
+	std::vector<MatchRange> oldFound(found.begin() + kept, found.end() );
+	found.resize(kept);
+	starts.resize(kept);
+
+	subject.replace(offset, length, replacement);
+	const size_t editEnd = offset + replacement.size();
+	auto moved = [&](size_t old) { return old - length + replacement.size(); };
+
+	size_t from = resumed, same = 0;
+	for(;;) {
+		if(from >= editEnd) {
+			const size_t old = from - replacement.size() + length;
+			while(same < oldStarts.size() && oldStarts[same] < old) {
+				same++;
+			}
+			if(same < oldStarts.size() && oldStarts[same] == old) {
+				for(size_t i = same; i < oldFound.size(); i++) {
+					MatchRange range = oldFound[i];
+					range.first = moved(range.first);
+					range.last = moved(range.last);
+					if(range.selected) {
+						range.selectedFirst = moved(range.selectedFirst);
+						range.selectedLast = moved(range.selectedLast);
+					}
+					found.push_back(range);
+					starts.push_back(moved(oldStarts[i]) );
+				}
+				break;
+			}
+		}
+		if(!search(from) ) {
+			from = subject.size();
+			break;
+		}
+		from = next(found.size() - 1);
+	}
+	scanned = std::min(from, subject.size() ) - std::min(resumed, subject.size() );
+}
@@ -0,0 +1,62 @@
+#pragma once
+#include "matcher.hpp"
+
+#include <string>
+#include <string_view>
+#include <vector>
+
+// A match and its selection as byte offsets, which unlike iterators stay
+// meaningful while the text is edited
+struct MatchRange {
+	size_t first, last;
+	// The span \O{n} selects, valid when selected is set
+	size_t selectedFirst, selectedLast;
+	bool selected;
+
+	bool operator==(const MatchRange &other) const {
+		return first == other.first && last == other.last && selected == other.selected
+			&& (!selected || (selectedFirst == other.selectedFirst && selectedLast == other.selectedLast) );
+	}
+};
+
+// Keeps the matches of a pattern in a text that is edited a few bytes at a
+// time, the same matches MatchPrinter::line() walks through: every search
+// starts where the last match ended, or one byte later after an empty match.
+//
+// An edit only searches the part of the text it can have changed the
+// matches of. A match that starts far enough before the edit, the longest
+// match of the pattern plus what a counter looks ahead, was decided without
+// looking at the edited bytes and is kept as it is, searching resumes after
+// the last of those. Once a search starts past the edit at a position the
+// previous scan also started a search at, the rest of the text is the same as
+// it was and the old matches from there on are only moved by the change in
+// length
+class IncrementalMatcher {
+public:
+	// The matcher must outlive this
+	IncrementalMatcher(Matcher &matcher, std::string text);
+
+	// Replaces length bytes at offset by replacement
+	void edit(size_t offset, size_t length, std::string_view replacement);
+
+	const std::string &text() const { return subject; }
+	const std::vector<MatchRange> &matches() const { return found; }
+	// Bytes the last edit, or the first scan, searched
+	size_t rescanned() const { return scanned; }
+private:
+	// Where the search after match i starts, past the end of the text if
+	// there is none
+	size_t next(size_t i) const;
+	// Records the first match at or after from and where its search started
+	bool search(size_t from);
+
+	Matcher &matcher;
+	std::string subject;
+	// How far past its start the search for a match can look, unbounded
+	// with a repetition
+	size_t reach;
+	std::vector<MatchRange> found;
+	// The position the search that found every match started at
+	std::vector<size_t> starts;
+	size_t scanned = 0;
+};
@@ -0,0 +1,230 @@
+#include "jit.hpp"
+
+#include <cstring>
+
+#include <sys/mman.h>
+
+namespace {
+
+void emit32(std::vector<uint8_t> &code, int32_t value) {
+	for(int i = 0; i < 4; i++) {
+		code.push_back(static_cast<uint32_t>(value) >> (8 * i) );
+	}
+}
+
+// Points the rel32 that ends at the given offset at target
+void patch32(std::vector<uint8_t> &code, size_t end, size_t target) {
+	const int32_t relative = static_cast<int32_t>(target) - static_cast<int32_t>(end);
+	std::memcpy(&code[end - 4], &relative, sizeof(relative) );
+}
+
+}
+
+JitScanner::~JitScanner() {
+	if(memory) {
+		munmap(memory, size);
+	}
+}
+
+// System V: rdi holds first, rsi last, the start of the match is returned
+// in rax, or zero. The caller makes sure that last - first >= length
+//
+// A position that accepts one or two bytes is the anchor, while 16 start
+// positions fit before the end they are tried at once: pcmpeqb compares the
+// anchor bytes of all 16 and every start whose anchor matched is checked in
+// turn. What is left is tried one start at a time
+//
+//         sub rsi, length             ; rsi = last start position
+//         movd xmm1, c1 * 0x01010101  ; anchor bytes in every lane
+//         movd xmm3, c2 * 0x01010101
+// wide:   lea rax, [rdi + 15]
+//         cmp rax, rsi
+//         ja narrow
+//         movdqu xmm0, [rdi + anchor]
+//         pcmpeqb xmm0, xmm1
+//         movdqu xmm2, [rdi + anchor]
+//         pcmpeqb xmm2, xmm3
+//         por xmm0, xmm2
+//         pmovmskb ecx, xmm0
+//         test ecx, ecx
+//         jz skip
+// found:  bsf edx, ecx
+//         lea r8, [rdi + rdx]
+//         ...                         ; positions checked against r8
+//         mov rax, r8
+//         ret
+// reject: lea eax, [rcx - 1]          ; drop the start just checked
+//         and ecx, eax
+//         jnz found
+// skip:   add rdi, 16
+//         jmp wide
+// narrow: cmp rdi, rsi
+//         ja none
+//         cmp byte [rdi + k], c       ; a position of one byte
+//         jne next
+//         movzx eax, byte [rdi + k]   ; a position of two bytes
+//         cmp al, c1
+//         je ok
+//         cmp al, c2
+//         jne next
+// ok:     ...                         ; every other position
+//         mov rax, rdi
+//         ret
+// next:   inc rdi
+//         jmp narrow
+// none:   xor eax, eax
+//         ret
+bool JitScanner::emit(const ShiftAnd &bitap, std::vector<uint8_t> &code) const {
+	const uint64_t *masks = bitap.table();
+	std::vector<std::vector<uint8_t>> positions(length);
+	for(size_t k = 0; k < length; k++) {
+		for(int byte = 0; byte < 256; byte++) {
+			if(masks[byte] >> k & 1) {
+				positions[k].push_back(byte);
+			}
+		}
+		if(positions[k].size() == 256) {
+			positions[k].clear();
+		} else if(positions[k].size() > 2) {
+			return false;
+		}
+	}
+
+	// Compares every position but skip with the start in rdi, or in r8,
+	// leaving the rel32 of every jump taken on a mismatch in fixups
+	auto checks = [&](bool r8, size_t skip, std::vector<size_t> &fixups) {
+		for(size_t k = 0; k < length; k++) {
+			const uint8_t offset = static_cast<uint8_t>(k);
+			if(k == skip || positions[k].empty() ) {
+				continue;
+			} else if(r8) {
+				code.push_back(0x41);
+			}
+			if(positions[k].size() == 1) {
+				code.insert(code.end(), {0x80, static_cast<uint8_t>(r8 ? 0x78 : 0x7F), offset, positions[k][0]});
+			} else {
+				code.insert(code.end(), {0x0F, 0xB6, static_cast<uint8_t>(r8 ? 0x40 : 0x47), offset});
+				code.insert(code.end(), {0x3C, positions[k][0], 0x74, 8, 0x3C, positions[k][1]});
+			}
+			code.insert(code.end(), {0x0F, 0x85});
+			emit32(code, 0);
+			fixups.push_back(code.size() );
+		}
+	};
+
+	size_t anchor = length;
+	for(size_t k = 0; k < length; k++) {
+		if(!positions[k].empty() && (anchor == length || positions[k].size() < positions[anchor].size() ) ) {
+			anchor = k;
+		}
+	}
+
+	code.insert(code.end(), {0x48, 0x83, 0xEE, static_cast<uint8_t>(length)});
+
+	size_t toNarrow = 0;
+	if(anchor < length) {
+		const bool pair = positions[anchor].size() == 2;
+		for(size_t i = 0; i < positions[anchor].size(); i++) {
+			code.push_back(0xB8);
+			emit32(code, static_cast<uint32_t>(positions[anchor][i]) * 0x01010101u);
+			code.insert(code.end(), {0x66, 0x0F, 0x6E, static_cast<uint8_t>(i ? 0xD8 : 0xC8)});
+			code.insert(code.end(), {0x66, 0x0F, 0x70, static_cast<uint8_t>(i ? 0xDB : 0xC9), 0x00});
+		}
+
+		const size_t wide = code.size();
+		code.insert(code.end(), {0x48, 0x8D, 0x47, 0x0F, 0x48, 0x39, 0xF0, 0x0F, 0x87});
+		emit32(code, 0);
+		toNarrow = code.size();
+		const uint8_t offset = static_cast<uint8_t>(anchor);
+		code.insert(code.end(), {0xF3, 0x0F, 0x6F, 0x47, offset, 0x66, 0x0F, 0x74, 0xC1});
+		if(pair) {
+			code.insert(code.end(), {0xF3, 0x0F, 0x6F, 0x57, offset, 0x66, 0x0F, 0x74, 0xD3});
+			code.insert(code.end(), {0x66, 0x0F, 0xEB, 0xC2});
+		}
+		code.insert(code.end(), {0x66, 0x0F, 0xD7, 0xC8, 0x85, 0xC9, 0x0F, 0x84});
+		emit32(code, 0);
+		const size_t toSkip = code.size();
+
+		const size_t found = code.size();
+		code.insert(code.end(), {0x0F, 0xBC, 0xD1, 0x4C, 0x8D, 0x04, 0x17});
+		std::vector<size_t> toReject;
+		checks(true, anchor, toReject);
+		code.insert(code.end(), {0x4C, 0x89, 0xC0, 0xC3});
+		const size_t reject = code.size();
+		code.insert(code.end(), {0x8D, 0x41, 0xFF, 0x21, 0xC1, 0x0F, 0x85});
+		emit32(code, 0);
+		patch32(code, code.size(), found);
+		const size_t skip = code.size();
+		code.insert(code.end(), {0x48, 0x83, 0xC7, 0x10, 0xE9});
+		emit32(code, 0);
+		patch32(code, code.size(), wide);
+
+		patch32(code, toSkip, skip);
+		for(size_t end : toReject) {
+			patch32(code, end, reject);
+		}
+	}
+
+	const size_t narrow = code.size();
+	if(toNarrow) {
+		patch32(code, toNarrow, narrow);
+	}
+	code.insert(code.end(), {0x48, 0x39, 0xF7, 0x0F, 0x87});
+	emit32(code, 0);
+	const size_t toNone = code.size();
+	std::vector<size_t> toNext;
+	checks(false, length, toNext);
+	code.insert(code.end(), {0x48, 0x89, 0xF8, 0xC3});
+	const size_t next = code.size();
+	code.insert(code.end(), {0x48, 0xFF, 0xC7, 0xE9});
+	emit32(code, 0);
+	patch32(code, code.size(), narrow);
+	const size_t none = code.size();
+	code.insert(code.end(), {0x31, 0xC0, 0xC3});
+
+	patch32(code, toNone, none);
+	for(size_t end : toNext) {
+		patch32(code, end, next);
+	}
+	return true;
+}
+
+bool JitScanner::compile(const ShiftAnd &bitap) {
+	if(!supported || compiled() || bitap.length() == 0 || bitap.length() > ShiftAnd::maxLength) {
+		return false;
+	}
+	length = bitap.length();
+	std::vector<uint8_t> code;
+	if(!emit(bitap, code) ) {
+		return false;
+	}
+
+	// Written while writable, executed once it no longer is
+	void *address = mmap(nullptr, code.size(), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if(address == MAP_FAILED) {
+		return false;
+	}
+	std::memcpy(address, code.data(), code.size() );
+	if(mprotect(address, code.size(), PROT_READ | PROT_EXEC) != 0) {
+		munmap(address, code.size() );
+		return false;
+	}
+	memory = address;
+	size = code.size();
+	function = reinterpret_cast<Function>(address);
+	return true;
+}
+
+bool JitScanner::search(Iterator first, Iterator last, Span &match) const {
+	if(static_cast<size_t>(last - first) < length) {
+		return false;
+	}
+	const char *begin = &*first;
+	const char *start = function(begin, begin + (last - first) );
+	if(!start) {
+		return false;
+	}
+	match.first = first + (start - begin);
+	match.last = match.first + length;
+	return true;
+}
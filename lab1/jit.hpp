@@ -0,0 +1,43 @@
+#pragma once
+#include "shiftand.hpp"
+
+#include <cstdint>
+#include <vector>
+
+// Native code for the patterns Shift-And accepts, on x86-64 Linux. Every
+// position of such a pattern is a byte, a pair of case variants or any byte,
+// the generated function tries every start position in turn and compares
+// the positions with immediates, leaving at the first byte that differs.
+// Positions that accept some other set of bytes are not compiled
+//
+// Defining LAB1_NO_JIT leaves the compiler out, compile() then always fails
+class JitScanner {
+public:
+#if defined(__x86_64__) && defined(__linux__) && !defined(LAB1_NO_JIT)
+	constexpr static bool supported = true;
+#else
+	constexpr static bool supported = false;
+#endif
+
+	JitScanner() = default;
+	JitScanner(const JitScanner &) = delete;
+	JitScanner &operator=(const JitScanner &) = delete;
+	~JitScanner();
+
+	// Returns false, leaving the scanner unusable, if bitap cannot be
+	// compiled or no executable memory could be had
+	bool compile(const ShiftAnd &bitap);
+	// Finds what ShiftAnd::search() finds
+	bool search(Iterator first, Iterator last, Span &match) const;
+	bool compiled() const { return function != nullptr; }
+	size_t codeSize() const { return size; }
+private:
+	using Function = const char *(*)(const char *first, const char *last);
+
+	bool emit(const ShiftAnd &bitap, std::vector<uint8_t> &code) const;
+
+	void *memory = nullptr;
+	size_t size = 0;
+	size_t length = 0;
+	Function function = nullptr;
+};
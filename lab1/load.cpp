@@ -0,0 +1,147 @@
+#include "load.hpp"
+#include "histogram.hpp"
+
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+struct Tally {
+	LatencyHistogram latencies;
+	size_t matched = 0, unmatched = 0, refused = 0;
+	bool failed = false;
+};
+
+int connectTo(const std::string &socketPath) {
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if(socketPath.size() >= sizeof(address.sun_path) ) {
+		return -1;
+	}
+	std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+	int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(fd >= 0 && connect(fd, reinterpret_cast<sockaddr*>(&address), sizeof(address) ) != 0) {
+		close(fd);
+		return -1;
+	}
+	return fd;
+}
+
+bool sendAll(int fd, const std::string &data) {
+	for(size_t sent = 0; sent < data.size(); ) {
+		ssize_t done = send(fd, data.data() + sent, data.size() - sent, MSG_NOSIGNAL);
+		if(done < 0 && errno != EINTR) {
+			return false;
+		}
+		sent += std::max<ssize_t>(done, 0);
+	}
+	return true;
+}
+
+// One connection, sending requests first, first + step, ... of lines
+void drive(const std::string &socketPath, const std::vector<std::string> &lines,
+	size_t first, size_t step, size_t count, size_t window, Tally &tally) {
+	int fd = connectTo(socketPath);
+	if(fd < 0) {
+		std::cerr << "Cannot connect to " << socketPath << ": " << std::strerror(errno) << '\n';
+		tally.failed = true;
+		return;
+	}
+	std::deque<Clock::time_point> inFlight;
+	std::string out, in;
+	char chunk[1 << 16];
+	size_t sent = 0, received = 0;
+	while(received < count) {
+		out.clear();
+		const auto now = Clock::now();
+		for(; sent < count && sent - received < window; sent++) {
+			out += lines[(first + sent * step) % lines.size()];
+			out += '\n';
+			inFlight.push_back(now);
+		}
+		if(!out.empty() && !sendAll(fd, out) ) {
+			break;
+		}
+
+		ssize_t got = read(fd, chunk, sizeof(chunk) );
+		if(got <= 0) {
+			break;
+		}
+		in.append(chunk, got);
+		const auto answered = Clock::now();
+		size_t start = 0, end;
+		while( (end = in.find('\n', start) ) != std::string::npos) {
+			tally.latencies.record(answered - inFlight.front() );
+			inFlight.pop_front();
+			const char kind = end > start ? in[start] : '!';
+			tally.matched += kind == '1';
+			tally.unmatched += kind == '0';
+			tally.refused += kind == '!';
+			received++;
+			start = end + 1;
+		}
+		in.erase(0, start);
+	}
+	if(received < count) {
+		std::cerr << "Connection lost after " << received << " of " << count << " answers\n";
+		tally.failed = true;
+	}
+	close(fd);
+}
+
+}
+
+bool generateLoad(const std::string &socketPath, const std::string &requestsPath,
+	unsigned connections, size_t count, size_t window) {
+	std::ifstream file(requestsPath);
+	std::vector<std::string> lines;
+	for(std::string line; std::getline(file, line); ) {
+		if(!line.empty() ) {
+			lines.push_back(std::move(line) );
+		}
+	}
+	if(lines.empty() ) {
+		std::cerr << "No requests in " << requestsPath << '\n';
+		return false;
+	}
+	connections = std::max(connections, 1u);
+
+	std::vector<Tally> tallies(connections);
+	std::vector<std::thread> threads;
+	const auto started = Clock::now();
+	for(unsigned i = 0; i < connections; i++) {
+		// The first connections take the requests that do not divide evenly
+		const size_t share = count / connections + (i < count % connections);
+		threads.emplace_back(drive, std::cref(socketPath), std::cref(lines), i, connections,
+			share, std::max<size_t>(window, 1), std::ref(tallies[i]) );
+	}
+	for(auto &thread : threads) {
+		thread.join();
+	}
+	const auto elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+
+	Tally total;
+	for(const Tally &tally : tallies) {
+		total.latencies.merge(tally.latencies);
+		total.matched += tally.matched;
+		total.unmatched += tally.unmatched;
+		total.refused += tally.refused;
+		total.failed |= tally.failed;
+	}
+	std::cerr << total.latencies.count() << " answers over " << connections << " connections in "
+		<< elapsed << " s, " << static_cast<uint64_t>(total.latencies.count() / std::max(elapsed, 1e-9) )
+		<< " requests/s\n"
+		<< total.matched << " matched, " << total.unmatched << " did not, "
+		<< total.refused << " refused\n"
+		<< "Latency from send to answer: " << total.latencies;
+	return !total.failed;
+}
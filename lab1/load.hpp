@@ -0,0 +1,11 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// Load generator for Server. Sends count requests, the lines of
+// requestsPath in turn, spread over connections connections that each keep
+// up to window requests in flight. Writes the answers by kind, the latency
+// from sending to answer and the throughput to stderr, returns whether
+// every request was answered
+bool generateLoad(const std::string &socketPath, const std::string &requestsPath,
+	unsigned connections, size_t count, size_t window = 64);
@@ -1,24 +1,191 @@
+#include "fuzz.hpp"
+#include "load.hpp"
 #include "node.hpp"
+#include "matcher.hpp"
+#include "output.hpp"
+#include "program.hpp"
+#include "server.hpp"
+#include "trigram.hpp"
+#include "utf8.hpp"
 
+#include <fstream>
+#include <limits>
+#include <random>
 #include <string_view>
+#include <thread>
 
-constexpr std::string_view Blue = "\x1B[93m";
-constexpr std::string_view Cyan = "\x1B[95m";
-constexpr std::string_view Reset = "\x1B[0m";
+// Flags of the output modes, in the order of OutputMode
+const std::array<std::string_view, 4> modeFlags = {"-h", "-c", "-b", "-o"};
 
 void visit(Node *node) {
-	Scope scope;
 	if(!node) {
 		std::cerr << "Bad\n";
 		return;
 	}
-	for(size_t i = 0; i < scope.depth - 1; i++) {
-		std::cout << "  ";
+	std::vector<std::pair<Node*, size_t>> stack = {{node, 0}};
+	while(!stack.empty() ) {
+		auto [current, depth] = stack.back();
+		stack.pop_back();
+		for(size_t i = 0; i < depth; i++) {
+			std::cout << "  ";
+		}
+		current->print();
+		for(auto it = current->children.rbegin(); it != current->children.rend(); it++) {
+			stack.emplace_back(it->get(), depth + 1);
+		}
 	}
-	node->print();
-	for(auto &c : node->children) {
-		visit(c.get() );
+}
+
+// Reads a count given on the command line into value, anything but digits
+// that fit in it is refused rather than thrown out of main
+template<typename T>
+bool parseCount(const std::string &text, T &value) {
+	if(text.empty() || !std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; }) ) {
+		return false;
+	}
+	try {
+		const unsigned long long parsed = std::stoull(text);
+		if(parsed > std::numeric_limits<T>::max() ) {
+			return false;
+		}
+		value = static_cast<T>(parsed);
+	} catch(const std::out_of_range &) {
+		return false;
+	}
+	return true;
+}
+
+// Parses one pattern per line of patternsPath into a program file, on as
+// many threads as there are cores
+int compile(const std::string &patternsPath, const std::string &programPath) {
+	std::ifstream file(patternsPath);
+	if(!file) {
+		std::cerr << "Cannot read " << patternsPath << '\n';
+		return EXIT_FAILURE;
+	}
+	std::vector<std::string> patterns;
+	std::vector<size_t> lines;
+	std::string pattern;
+	for(size_t line = 1; std::getline(file, pattern); line++) {
+		if(!pattern.empty() ) {
+			patterns.push_back(std::move(pattern) );
+			lines.push_back(line);
+		}
+	}
+
+	const unsigned threads = std::max(std::thread::hardware_concurrency(), 1u);
+	const auto start = Clock::now();
+	ProgramWriter writer;
+	std::vector<size_t> failed = writer.addAll(patterns, threads);
+	const double ms = std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	if(!failed.empty() ) {
+		for(size_t i : failed) {
+			std::cerr << patternsPath << ':' << lines[i] << ": cannot parse " << patterns[i] << '\n';
+		}
+		return EXIT_FAILURE;
+	}
+	if(!writer.write(programPath) ) {
+		std::cerr << "Cannot write " << programPath << '\n';
+		return EXIT_FAILURE;
+	}
+	std::cout << "Compiled " << writer.size() << " patterns into " << programPath << '\n';
+	std::cerr << "Compiled in " << ms << " ms on up to " << threads << " threads, "
+		<< writer.nodesStored() << " of " << writer.nodesParsed() << " nodes stored, dedup ratio "
+		<< static_cast<double>(writer.nodesParsed() ) / std::max<size_t>(writer.nodesStored(), 1) << '\n';
+	return EXIT_SUCCESS;
+}
+
+// Highlights every line of standard input once per pattern of the program
+// that matches it
+int runProgram(const std::string &programPath) {
+	Program program;
+	if(!program.map(programPath) ) {
+		program.printErr();
+		return EXIT_FAILURE;
+	}
+	std::vector<std::unique_ptr<Matcher>> matchers;
+	matchers.reserve(program.size() );
+	for(size_t i = 0; i < program.size(); i++) {
+		matchers.push_back(std::make_unique<Matcher>(program, i) );
 	}
+	Output out;
+	MatchPrinter printer(out, OutputMode::Highlight);
+	std::string input;
+	while(std::getline(std::cin, input) ) {
+		for(size_t i = 0; i < matchers.size(); i++) {
+			if(matchers[i]->any(input.cbegin(), input.cend() ) ) {
+				out.write(program.source(i) );
+				out.write(": ");
+				printer.line(*matchers[i], input);
+			}
+		}
+	}
+	printer.finish();
+	return EXIT_SUCCESS;
+}
+
+int index(const std::string &corpusPath, const std::string &indexPath) {
+	MappedFile corpus;
+	if(const char *why = corpus.map(corpusPath) ) {
+		std::cerr << "Cannot read " << corpusPath << ": " << why << '\n';
+		return EXIT_FAILURE;
+	}
+	TrigramIndexWriter writer;
+	writer.index(std::string_view(corpus.data(), corpus.size() ) );
+	if(!writer.write(indexPath) ) {
+		std::cerr << "Cannot write " << indexPath << '\n';
+		return EXIT_FAILURE;
+	}
+	std::cout << "Indexed " << writer.lines() << " lines, " << writer.trigrams() 
+		<< " trigrams into " << indexPath << '\n';
+	return EXIT_SUCCESS;
+}
+
+// Only the lines the trigram query of the pattern selects reach the matcher
+int query(const std::string &indexPath, const std::string &corpusPath, const std::string &pattern) {
+	TrigramIndex index;
+	if(!index.map(indexPath) ) {
+		index.printErr();
+		return EXIT_FAILURE;
+	}
+	MappedFile corpus;
+	if(const char *why = corpus.map(corpusPath) ) {
+		std::cerr << "Cannot read " << corpusPath << ": " << why << '\n';
+		return EXIT_FAILURE;
+	}
+	if(corpus.size() != index.corpusSize() ) {
+		std::cerr << indexPath << " is stale, " << corpusPath << " has changed since it was indexed\n";
+		return EXIT_FAILURE;
+	}
+
+	Tokenizer tokenizer;
+	Parser parser;
+	Child root = parser.parseTokens(tokenizer.tokenize(pattern) );
+	if(!root) {
+		parser.printErr();
+		return EXIT_FAILURE;
+	}
+	TrigramQuery plan = planTrigrams(root.get() );
+	std::cerr << "Trigram query: " << plan << '\n';
+
+	Matcher matcher(std::move(root), parser.groups() );
+	auto candidates = index.candidates(plan);
+	Output out;
+	MatchPrinter printer(out, OutputMode::Highlight);
+	std::string input;
+	for(uint32_t line : candidates) {
+		const TrigramLine &range = index.line(line);
+		input.assign(corpus.data() + range.first, corpus.data() + range.last);
+		if(matcher.any(input.cbegin(), input.cend() ) ) {
+			out.number(line + 1);
+			out.write(": ");
+			printer.line(matcher, input);
+		}
+	}
+	printer.finish();
+	std::cerr << "Checked " << candidates.size() << " of " << index.lines() 
+		<< " lines, " << printer.matchingLines() << " matched\n";
+	return EXIT_SUCCESS;
 }
 
 int main(int argc, char **argv) {
@@ -28,41 +195,158 @@ int main(int argc, char **argv) {
 	args.resize(argc - 1);
 	std::copy(argv + 1, argv + argc, args.begin() );
 
-	std::string input;
-	if(!std::getline(std::cin, input) ) {
+	if(args.front() == "--compile") {
+		if(args.size() != 3) {
+			std::cerr << "Usage: " << argv[0] << " --compile patterns.txt out.bin\n";
+			return EXIT_FAILURE;
+		}
+		return compile(args[1], args[2]);
+	}
+
+	if(args.front() == "--index") {
+		if(args.size() != 3) {
+			std::cerr << "Usage: " << argv[0] << " --index corpus.txt out.idx\n";
+			return EXIT_FAILURE;
+		}
+		return index(args[1], args[2]);
+	}
+
+	if(args.front() == "--query") {
+		if(args.size() != 4) {
+			std::cerr << "Usage: " << argv[0] << " --query corpus.idx corpus.txt pattern\n";
+			return EXIT_FAILURE;
+		}
+		return query(args[1], args[2], args[3]);
+	}
+
+	if(args.front() == "--fuzz") {
+		unsigned seed = 0;
+		size_t count = 0;
+		if(args.size() < 2 || args.size() > 3 || !parseCount(args[1], count)
+			|| (args.size() > 2 && !parseCount(args[2], seed) ) ) {
+			std::cerr << "Usage: " << argv[0] << " --fuzz count [seed]\n";
+			return EXIT_FAILURE;
+		}
+		if(args.size() == 2) {
+			seed = std::random_device()();
+		}
+		std::cerr << "Seed " << seed << '\n';
+		const size_t mismatches = fuzzEngines(count, seed) + fuzzEdits(count, seed);
+		return mismatches ? EXIT_FAILURE : EXIT_SUCCESS;
+	}
+
+	if(args.front() == "--serve") {
+		unsigned workers = std::max(std::thread::hardware_concurrency(), 1u);
+		if(args.size() < 2 || args.size() > 3 || (args.size() > 2 && !parseCount(args[2], workers) ) ) {
+			std::cerr << "Usage: " << argv[0] << " --serve socket [workers]\n";
+			return EXIT_FAILURE;
+		}
+		Server server(workers);
+		if(const char *why = server.listen(args[1]) ) {
+			std::cerr << "Cannot listen on " << args[1] << ": " << why << '\n';
+			return EXIT_FAILURE;
+		}
+		return server.run() ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if(args.front() == "--load") {
+		unsigned connections = 4;
+		size_t count = 100000;
+		if(args.size() < 3 || args.size() > 5 || (args.size() > 3 && !parseCount(args[3], connections) )
+			|| (args.size() > 4 && !parseCount(args[4], count) ) ) {
+			std::cerr << "Usage: " << argv[0] << " --load socket requests.txt [connections [count]]\n";
+			return EXIT_FAILURE;
+		}
+		return generateLoad(args[1], args[2], connections, count) ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if(args.front() == "--program") {
+		if(args.size() != 2) {
+			std::cerr << "Usage: " << argv[0] << " --program program.bin\n";
+			return EXIT_FAILURE;
+		}
+		return runProgram(args[1]);
+	}
+
+	const std::string usage = std::string("Usage: ") + argv[0] + " [-c|-b|-o|-u|--explain|--max-depth N] pattern\n";
+	OutputMode mode = OutputMode::Highlight;
+	auto pattern = args.begin();
+	bool explain = false, utf8 = false;
+	unsigned maxDepth = defaultMaxDepth;
+	for(; pattern != args.end() && pattern->size() >= 2 && pattern->front() == '-'; pattern++) {
+		if(*pattern == "--explain") {
+			explain = true;
+			continue;
+		}
+		if(*pattern == "--max-depth") {
+			if(++pattern == args.end() || !parseCount(*pattern, maxDepth) ) {
+				std::cerr << usage;
+				return EXIT_FAILURE;
+			}
+			continue;
+		}
+		if(*pattern == "-u") {
+			utf8 = true;
+			continue;
+		}
+		auto it = std::find(modeFlags.begin(), modeFlags.end(), *pattern);
+		if(it == modeFlags.end() ) {
+			break;
+		}
+		mode = static_cast<OutputMode>(std::distance(modeFlags.begin(), it) );
+	}
+	if(pattern == args.end() ) {
+		std::cerr << usage;
+		return EXIT_FAILURE;
+	}
+
+	if(utf8 && !isValidUtf8(pattern->data(), pattern->data() + pattern->size() ) ) {
+		std::cerr << "Pattern is not valid UTF-8\n";
 		return EXIT_FAILURE;
 	}
 
 	Tokenizer tokenizer;
-	Tokens tokens = tokenizer.tokenize(args.front() );
+	Tokens tokens = tokenizer.tokenize(*pattern);
 	//tokenizer.print();
 
-	std::cout << args.front() << '\n';
-	puts(std::string(args.front().size(), '=').c_str() );
-
-	Parser parser;
-	auto root = parser.parseTokens(std::move(tokens) );
+	Parser parser(maxDepth);
+	Child root = parser.parseTokens(std::move(tokens) );
 	if(!root) {
 		parser.printErr();
 		return EXIT_FAILURE;
-	} else {
+	}
+
+	// The tree is only dumped above highlighted lines, the other modes write
+	// nothing but what they were asked for
+	if(mode == OutputMode::Highlight && !explain) {
+		std::cout << *pattern << '\n';
+		puts(std::string(pattern->size(), '=').c_str() );
 		visit(root.get() );
+		std::cout.flush();
 	}
 	
-	state.strBegin = state.resBegin = state.resEnd = input.cbegin();
-	state.strEnd = input.cend();
-
-	bool result = root->eval();
-	std::cout << std::string(input.cbegin(), state.resBegin);
-	int i = 1;
-	while(result) {
-		std::cout << (i++ % 2 ? Blue : Cyan) 
-			<< std::string(state.resBegin, state.resEnd) << Reset;
-		auto it = state.resBegin = state.resEnd;
-		result = root->eval();
-		std::cout << std::string(it, state.resBegin);
-	}
-	std::cout << std::string(state.resEnd, input.cend() ) << '\n';
+	Matcher matcher(std::move(root), parser.groups() );
+	matcher.setUtf8(utf8);
+	if(explain) {
+		std::cout << matcher.plan();
+		return EXIT_SUCCESS;
+	}
+
+	Output out;
+	MatchPrinter printer(out, mode);
+	std::string input;
+	size_t line = 0;
+	while(std::getline(std::cin, input) ) {
+		line++;
+		// Decoding trusts the subject, lines that are not UTF-8 are left out
+		if(utf8 && !isValidUtf8(input.data(), input.data() + input.size() ) ) {
+			std::cerr << "Line " << line << " is not valid UTF-8, skipped\n";
+			printer.skip(input);
+			continue;
+		}
+		printer.line(matcher, input);
+	}
+	printer.finish();
 
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,46 @@
+#include "mapped.hpp"
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+MappedFile::~MappedFile() {
+	if(base) {
+		munmap(const_cast<char*>(base), length);
+	}
+}
+
+const char *MappedFile::map(const std::string &path) {
+	int fd = open(path.c_str(), O_RDONLY);
+	if(fd < 0) {
+		return "cannot open file";
+	}
+	struct stat info;
+	if(fstat(fd, &info) != 0) {
+		close(fd);
+		return "cannot stat file";
+	}
+	// Mapping nothing fails, an empty file is just empty
+	if(info.st_size == 0) {
+		close(fd);
+		return nullptr;
+	}
+	void *address = mmap(nullptr, info.st_size, PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if(address == MAP_FAILED) {
+		return "cannot map file";
+	}
+	base = static_cast<const char*>(address);
+	length = info.st_size;
+	return nullptr;
+}
+
+uint64_t checksum(const char *first, const char *last) {
+	uint64_t hash = 14695981039346656037u;
+	for(; first != last; first++) {
+		hash ^= static_cast<unsigned char>(*first);
+		hash *= 1099511628211u;
+	}
+	return hash;
+}
@@ -0,0 +1,35 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+// A whole file mapped read-only, shared with every other process that maps it
+class MappedFile {
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+	~MappedFile();
+
+	// Returns why the file could not be mapped, or nullptr
+	const char *map(const std::string &path);
+	const char *data() const { return base; }
+	size_t size() const { return length; }
+private:
+	const char *base = nullptr;
+	size_t length = 0;
+};
+
+// FNV-1a, guards the file formats against truncation and bit rot
+uint64_t checksum(const char *first, const char *last);
+
+// File sections start on 8 byte boundaries
+inline uint64_t align(uint64_t offset) {
+	return (offset + 7) & ~uint64_t(7);
+}
+
+// Whether an aligned section of count elements of size bytes at offset fits
+// in a file of length bytes
+inline bool fits(uint64_t offset, uint64_t count, uint64_t size, uint64_t length) {
+	return offset % 8 == 0 && offset <= length && count <= (length - offset) / size;
+}
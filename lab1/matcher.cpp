@@ -0,0 +1,165 @@
+#include "matcher.hpp"
+#include "utf8.hpp"
+
+#include <string_view>
+
+namespace {
+
+std::string_view view(Iterator first, Iterator last) {
+	return first == last ? std::string_view() : std::string_view(&*first, last - first);
+}
+
+bool isAscii(Iterator first, Iterator last) {
+	auto subject = view(first, last);
+	return ::isAscii(subject.data(), subject.data() + subject.size() );
+}
+
+}
+
+Matcher::Matcher(Child root, unsigned groupCount) 
+	: tree(std::move(root) ), groupCount(groupCount) {
+	if(auto selectionGroup = dynamic_cast<NodeSelectionGroup*>(tree.get() ) ) {
+		selection = selectionGroup->value;
+	}
+	bitap.compile(tree.get() );
+	planned = planPattern(tree.get(), groupCount, bitap);
+	current = planned.engine;
+}
+
+Matcher::Matcher(const Program &program, size_t index) : program(&program) {
+	const ProgramPattern &pattern = program.pattern(index);
+	programRoot = pattern.root;
+	groupCount = pattern.groups;
+	selection = std::max(pattern.selection, 0);
+	// Without the tree only a Shift-And pattern has a known longest match
+	planned.properties.maxLength = unbounded;
+	if(pattern.table != ProgramFormat::noTable) {
+		bitap.view(program.table(pattern.table), pattern.tableLength);
+		planned.engine = current = Engine::ShiftAnd;
+		planned.properties.maxLength = pattern.tableLength;
+	}
+}
+
+void Matcher::setUtf8(bool enabled) {
+	utf8 = enabled;
+	if(tree) {
+		planned = planPattern(tree.get(), groupCount, bitap, utf8);
+		current = planned.engine;
+	}
+}
+
+bool Matcher::use(Engine engine) {
+	// The native code runs the Shift-And table, it goes where that can
+	const Engine planAs = engine == Engine::Jit ? Engine::ShiftAnd : engine;
+	for(auto &choice : planned.choices) {
+		if(choice.engine == planAs && !choice.eligible) {
+			return false;
+		}
+	}
+	if((engine == Engine::ShiftAnd && bitap.length() == 0) 
+		|| (engine == Engine::Literal && planned.literal.empty() ) 
+		|| (engine == Engine::Jit && !jit.compiled() && !jit.compile(bitap) ) ) {
+		return false;
+	}
+	current = engine;
+	return true;
+}
+
+bool Matcher::evalRoot() const {
+	return program ? program->eval(programRoot) : tree->eval();
+}
+
+bool Matcher::decodes(Iterator first, Iterator last) const {
+	return utf8 && (planned.properties.foldsNonAscii || !isAscii(first, last) );
+}
+
+bool Matcher::find(Iterator first, Iterator last, Span &match) {
+	return find(first, last, match, decodes(first, last) );
+}
+
+bool Matcher::find(Iterator first, Iterator last, Span &match, bool decode) {
+	// Shift-And and the native code compare bytes, a subject that is not
+	// all ASCII has to be decoded by the backtracker. A literal is valid UTF-8
+	// and only ever matches whole code points
+	const Engine engine = decode && current != Engine::Literal ? Engine::Backtrack : current;
+	switch(engine) {
+		case Engine::Literal: {
+			auto subject = view(first, last);
+			auto at = subject.find(planned.literal);
+			if(at == std::string_view::npos) {
+				return false;
+			}
+			match = Span{first + at, first + at + planned.literal.size()};
+			return true;
+		}
+		case Engine::ShiftAnd:
+			if(++finds == jitThreshold) {
+				promote();
+			}
+			return bitap.search(first, last, match);
+		case Engine::Jit:
+			return jit.search(first, last, match);
+		case Engine::Backtrack:
+			break;
+	}
+
+	// Every match contains the literal, without it there is nothing to try
+	if(!planned.literal.empty() && view(first, last).find(planned.literal) == std::string_view::npos) {
+		return false;
+	}
+
+	state.captures = false;
+	state.utf8 = decode;
+	state.groupings.clear();
+	state.reset(first, last);
+	bool result = evalRoot();
+	match = Span{state.resBegin, state.resEnd};
+	return result;
+}
+
+// Patterns that cannot be compiled keep running on Shift-And
+void Matcher::promote() {
+	if(!jitFailed && jit.compile(bitap) ) {
+		current = Engine::Jit;
+	} else {
+		jitFailed = true;
+	}
+}
+
+bool Matcher::any(Iterator first, Iterator last) {
+	Span match;
+	return find(first, last, match);
+}
+
+bool Matcher::groups(const Span &match, std::vector<Span> &out) {
+	state.captures = true;
+	state.utf8 = decodes(match.first, match.last);
+	state.groupings.assign(groupCount, Span{match.last, match.last});
+	state.reset(match.first, match.last);
+	bool result = evalRoot();
+	out.swap(state.groupings);
+	return result;
+}
+
+bool Matcher::resume(Iterator &from, const Span &match, Iterator last) {
+	if(match.last != from) {
+		from = match.last;
+	} else if(from != last) {
+		from++;
+	} else {
+		return false;
+	}
+	return true;
+}
+
+bool Matcher::select(const Span &match, Span &selected) {
+	if(selection == 0) {
+		selected = match;
+		return true;
+	}
+	if(!groups(match, scratch) || selection > scratch.size() ) {
+		return false;
+	}
+	selected = scratch[selection - 1];
+	return true;
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include "jit.hpp"
+#include "node.hpp"
+#include "planner.hpp"
+#include "program.hpp"
+#include "shiftand.hpp"
+
+// Two phase matching. Match bounds are located by a pass that records no
+// groupings, either bit-parallel or by the backtracker with captures turned
+// off. Groupings, and with them the \O{n} selection, are only computed when
+// asked for, by running the capture aware evaluator over the matched span.
+// The engine that locates the bounds is the one the planner picked, a
+// Shift-And pattern is compiled to native code once it has been used to find
+// jitThreshold times
+class Matcher {
+public:
+	constexpr static size_t jitThreshold = 1024;
+
+	Matcher(Child root, unsigned groupCount);
+	// Matches with pattern index of a mapped program, evaluating its flat
+	// nodes and Shift-And table in place. The program must outlive the matcher
+	Matcher(const Program &program, size_t index);
+
+	// Bounds of the first match in [first, last). In UTF-8 mode this looks
+	// through [first, last) for bytes outside ASCII, a caller that searches
+	// one subject over and over asks decodes() once and passes it on
+	bool find(Iterator first, Iterator last, Span &match);
+	bool find(Iterator first, Iterator last, Span &match, bool decode);
+	// Whether [first, last) has to be matched by code point
+	bool decodes(Iterator first, Iterator last) const;
+	bool any(Iterator first, Iterator last);
+	// Groupings of a match previously returned by find
+	bool groups(const Span &match, std::vector<Span> &out);
+	// The span selected by \O{n}, or the match itself without a selection
+	bool select(const Span &match, Span &selected);
+	// Moves from, where the search that found match started, to where the
+	// search for the next match starts. That is where match ended, or one
+	// byte later after an empty match, which would be found again where it
+	// was. Returns false if the search would start past last
+	static bool resume(Iterator &from, const Span &match, Iterator last);
+
+	// Switches to another engine, returns false if it cannot match the
+	// pattern. Meant for comparing engines, find() is the same either way
+	bool use(Engine engine);
+
+	// Matches code points of UTF-8 subjects rather than bytes, subjects have
+	// to be valid UTF-8. Subjects that are all ASCII stay on the byte engines,
+	// unless the pattern folds code points outside ASCII. Plans the pattern
+	// again, call it before matching
+	void setUtf8(bool enabled);
+
+	Node *root() const { return tree.get(); }
+	const Plan &plan() const { return planned; }
+	Engine engine() const { return current; }
+	bool selects() const { return selection > 0; }
+private:
+	bool evalRoot() const;
+
+	Child tree;
+	const Program *program = nullptr;
+	uint32_t programRoot = 0;
+	unsigned groupCount;
+	unsigned selection = 0;
+	void promote();
+
+	ShiftAnd bitap;
+	JitScanner jit;
+	size_t finds = 0;
+	bool jitFailed = false;
+	bool utf8 = false;
+	Plan planned;
+	Engine current = Engine::Backtrack;
+	std::vector<Span> scratch;
+};
@@ -1,196 +1,85 @@
 #include "node.hpp"
+#include "evaluate.hpp"
 
-unsigned Scope::depth = 0;
-
-State state;
-
-Scope::Scope() {
-	++depth;
-}
-
-Scope::~Scope() {
-	--depth;
-}
+thread_local State state;
 
 void Node::addChild(Child child) {
 	children.push_back(std::move(child) );
 }
 
 bool NodeSequence::eval() {
-	return evalPlane(children);
-}
-
-bool evalPlane(std::vector<Child> &plane) {
-ALGO_START:
-	auto old = state.resEnd;
-	bool res = plane.front()->eval();
-	while(!res && state.strEnd != state.resEnd) {
-		state.resEnd = ++state.resBegin;
-		res = plane.front()->eval();
-	}
-	auto multiplePlaneCheck = state.resBegin;
-
-	for(int i = 1; i < plane.size() && res; i++) {
-		if(state.wasGreedy) {
-			state.wasGreedy = false;
-			auto back = state.strEnd;
-			state.resEnd = back;
-			res = plane[i]->eval();
-			while(!res && old != state.resEnd) {
-				state.resEnd = --back;
-				res = plane[i]->eval();
-			}
-			if(!res) {
-				state.resEnd = state.resBegin = state.strEnd;
-				return false;
-			} 
-			if(!state.groupings.empty()) {
-				state.groupings[state.lastGrouping].last = back;
-			}
-			old = state.resEnd;
-		} else {
-			old = state.resEnd;
-			res = plane[i]->eval();
-		}
-		
-	}
-
-	if(!res && state.resEnd != state.strEnd) {
-		goto ALGO_START;
-	}
-
-	if(multiplePlaneCheck != state.resBegin) {
-		return false;
-	}
-
-	// Cutoff error fix
-	if(!res) {
-		state.resBegin = state.strEnd;
-	}
-	return res;
+	return evalPlane(children.size(), [this](size_t i) { return children[i]->eval(); });
 }
 
 bool NodeSelectionGroup::eval() {
-	bool res = children.front()->eval();
-	if(res && value > 0) {
-		state.resBegin = state.groupings[value - 1].first;
-		state.resEnd = state.groupings[value - 1].last;
-	} else if(!res) {
-		state.resBegin = state.resEnd = state.strEnd;
-	}
-	return res;
+	return evalSelectionGroup(value, [this] { return children.front()->eval(); });
 }
 
 bool NodeGrouping::eval() {
-	auto start = state.resEnd;
-	bool res = children.front()->eval();
-	state.groupings[index] = res ? Span{start, state.resEnd} 
-		: Span{state.strEnd, state.strEnd};
-	state.lastGrouping = index;
-	return res;
+	return evalGrouping(index, [this] { return children.front()->eval(); });
 }
 
 bool NodeCaseInsensitive::eval() {
-	state.caseInsDepth++;
-	bool result = children.front()->eval();
-	state.caseInsDepth--;
-	return result;
+	return evalCaseInsensitive([this] { return children.front()->eval(); });
 }
 
 bool NodeRepeated::eval() {
-	state.cameFromWildcard = false;
-	bool result = children.front()->eval();
-	if(!result) {
-		return false;
-	}
-	auto prev = std::prev(state.resEnd);
-	if(*state.resEnd == *prev) {
-		while(state.resEnd < state.strEnd && *state.resEnd == *prev) {
-			state.resEnd++;
-		}
-		return true;
-	} else if(state.cameFromWildcard) {
-		state.cameFromWildcard = false;
-		state.wasGreedy = true;
-		state.resEnd = state.strEnd;
-	}
-	return true;
+	return evalRepeated([this] { return children.front()->eval(); });
 }
 
 bool NodeEither::eval() {
-	State save = state;
-	bool lhsSuccess = children.front()->eval();
-	State lhsState = state;
-	state = save;
-	bool rhsSuccess = children.back()->eval();
-	State rhsState = state;
-
-	if(!lhsSuccess && !rhsSuccess) {
-		state = rhsState.resEnd < lhsState.resEnd ? rhsState : lhsState;
-		return false;
-	} else if(lhsSuccess && !rhsSuccess) {
-		state = lhsState;
-		return true;
-	} else if(!lhsSuccess && rhsSuccess) {
-		state = rhsState;
-		return true;
-	}
-
-	// Both suceeded, find out which one progressed the furthest
-	state = rhsState.resBegin <= lhsState.resBegin ? rhsState : lhsState;
-	return true;
+	return evalEither(children.size(), [this](size_t i) { return children[i]->eval(); });
 }
 
 bool NodeCounter::eval() {
-	if(std::distance(state.resEnd, state.strEnd) < value) {
-		return false;
-	}
-	for(int i = 0; i < value; i++) {
-		if(!children.front()->eval() ) {
-			return false;
-		}
-	}
-	return true;
+	return evalCounter(value, [this] { return children.front()->eval(); });
 }
 
 bool NodeString::eval() {
-	for(auto c : value) {
-		const bool isUpper = state.caseInsDepth == 0;
-		if(isUpper) {
-			if(state.resEnd == state.strEnd || *state.resEnd != c) {
-				return false;
-			}
-		} else if(std::toupper(*state.resEnd) != std::toupper(c)) {
-			return false;
-		}
-		state.resEnd++;
-	}
-	return true;
+	return evalString(value.data(), value.size() );
 }
 
 bool NodeWildcard::eval() {
-	if(state.resEnd == state.strEnd) {
-		return false;
-	}
-	state.resEnd++;
-	state.cameFromWildcard = true;
-	return true;
+	return evalWildcard();
 }
 
 Child Parser::parseTokens(Tokens &&tokens) {
 	this->tokens = std::move(tokens);
 	this->iterator = this->tokens.begin();
+	depth = 0;
+	groupCount = 0;
+	tooDeep = false;
 	auto seq = buildSequence();
-	if(end() ) {
+	if(end() && !tooDeep) {
 		return seq;
 	}
 	return nullptr;
 }
 
 void Parser::printErr() const {
+	if(tooDeep) {
+		std::cerr << "Pattern nests deeper than " << maxDepth << " levels\n";
+		return;
+	}
 	std::cerr << iterator - tokens.begin() << '\n';
 }
 
+Parser::Nesting::Nesting(Parser &parser) : parser(parser) {
+	++parser.depth;
+}
+
+Parser::Nesting::~Nesting() {
+	--parser.depth;
+}
+
+// Every sequence and every unary operator adds a level to the tree
+bool Parser::deeper() {
+	if(depth >= maxDepth) {
+		tooDeep = true;
+	}
+	return !tooDeep;
+}
+
 bool Parser::end() const {
 	return iterator == tokens.end();
 }
@@ -202,7 +91,11 @@ Token *Parser::getIf(TokenType::Type token) {
 	return &*(iterator++);
 }
 
-Child Parser::buildSequence() {
+Child Parser::buildSequence(bool alternative) {
+	Nesting nesting(*this);
+	if(!deeper() ) {
+		return nullptr;
+	}
 	Child sequence = std::make_unique<NodeSequence>();
 	while(!end() ) {
 		Child child = buildValue();
@@ -225,12 +118,23 @@ Child Parser::buildSequence() {
 			return sequence;
 		}
 
+		unsigned unaryDepth = depth;
 		Child unexpr = buildUnExpression(child);
 		while(unexpr) {
 			child = std::move(unexpr);
+			if(++unaryDepth > maxDepth) {
+				tooDeep = true;
+				return nullptr;
+			}
 			unexpr = buildUnExpression(child);
 		}
 
+		// The next + adds an alternative to the either being built, rather
+		// than an either nested in this one
+		if(alternative && sequence->children.empty() && !end() && iterator->type == TokenType::Either) {
+			sequence->addChild(std::move(child) );
+			return sequence;
+		}
 
 		Child seq = std::make_unique<NodeSequence>();
 		Child binexpr = buildBinExpression(seq);
@@ -315,8 +219,7 @@ Child Parser::buildGrouping() {
 	}
 
 	std::unique_ptr<NodeGrouping> parent(new NodeGrouping() );
-	parent->index = state.groupings.size();
-	state.groupings.emplace_back();
+	parent->index = groupCount++;
 
 	parent->addChild(std::move(child) );
 
@@ -337,15 +240,20 @@ Child Parser::buildRepeated(Child &child) {
 	return repeat;
 }
 
+// A chain a+b+c is one either with an alternative per operand. Only the last
+// alternative takes the rest of the sequence, so a long alternation is
+// parsed in a loop and adds no nesting
 Child Parser::buildEither(Child &child) {
 	if(!getIf(TokenType::Either) ) return nullptr;
 	Child either = std::make_unique<NodeEither>();
-	auto rhs = buildSequence();
-	if(!rhs) {
-		return nullptr;
-	}
 	either->addChild(std::move(child) );
-	either->addChild(std::move(rhs) );
+	do {
+		auto rhs = buildSequence(true);
+		if(!rhs) {
+			return nullptr;
+		}
+		either->addChild(std::move(rhs) );
+	} while(getIf(TokenType::Either) );
 	return either;
 }
 
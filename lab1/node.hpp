@@ -10,19 +10,19 @@ class Node;
 using Child = std::unique_ptr<Node>;
 using Iterator = std::string::const_iterator;
 
-struct Scope {
-	Scope();
-	~Scope();
-	static unsigned depth;
-};
-
 struct Span {
 	Iterator first, last;
 };
 
 struct State {
 	std::vector<Span> groupings;
-	unsigned caseInsDepth;
+	// Groupings are only recorded when set, a capture free pass leaves
+	// groupings empty and only locates the bounds of the match
+	bool captures = true;
+	// Wildcards, repetitions and \I work on UTF-8 code points when set,
+	// the subject has to be valid UTF-8
+	bool utf8 = false;
+	unsigned caseInsDepth = 0;
 	unsigned lastGrouping = 0;
 	Iterator strBegin;
 	Iterator strEnd;
@@ -30,20 +30,31 @@ struct State {
 	Iterator resEnd;
 	bool cameFromWildcard = false;
 	bool wasGreedy = false;
+
+	// Starts a new attempt at first, flags left over from an earlier
+	// evaluation must not leak into the next one
+	void reset(Iterator first, Iterator last) {
+		strBegin = resBegin = resEnd = first;
+		strEnd = last;
+		caseInsDepth = 0;
+		lastGrouping = 0;
+		cameFromWildcard = false;
+		wasGreedy = false;
+	}
 };
 
-extern State state;
+// Evaluation state of the calling thread, matchers can run on several threads
+extern thread_local State state;
 
 class Node {
 public:
+	virtual ~Node() = default;
 	virtual void print() = 0;
 	virtual bool eval() = 0;
 	void addChild(Child child);
 	std::vector<Child> children;
 };
 
-bool evalPlane(std::vector<Child> &plane);
-
 class NodeSequence : public Node {
 public:
 	void print() override { std::cout << "Sequence\n"; }
@@ -103,14 +114,33 @@ public:
 	bool eval() override;
 };
 
+// Patterns that nest deeper than this are rejected by the parser, the command
+// line can set another limit. Both the parser and Node::eval() recurse once
+// per level of nesting, so the limit is also what keeps evaluation within the
+// call stack. The alternatives of a chain a+b+c are one level, neither
+// recurses over them
+constexpr unsigned defaultMaxDepth = 1000;
+
 class Parser {
 public:
+	explicit Parser(unsigned maxDepth = defaultMaxDepth) : maxDepth(maxDepth) {}
 	Child parseTokens(Tokens &&tokens);
 	void printErr() const;
+	// Number of groupings in the last parsed pattern
+	unsigned groups() const { return groupCount; }
 private:
+	struct Nesting {
+		Nesting(Parser &parser);
+		~Nesting();
+		Parser &parser;
+	};
+
+	bool deeper();
 	bool end() const;
 	Token *getIf(TokenType::Type token);
-	Child buildSequence();
+	// An alternative of an either chain ends before the + that follows its
+	// first operand
+	Child buildSequence(bool alternative = false);
 	Child buildBinExpression(Child &child);
 	Child buildUnExpression(Child &child);
 	Child buildValue();
@@ -126,4 +156,8 @@ private:
 	Tokens tokens;
 	TokenIterator iterator;
 	bool mayStar = true;
+	unsigned maxDepth;
+	unsigned depth = 0;
+	unsigned groupCount = 0;
+	bool tooDeep = false;
 };
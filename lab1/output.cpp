@@ -0,0 +1,139 @@
+#include "output.hpp"
+
+#include <cerrno>
+#include <charconv>
+#include <cstring>
+
+void Output::write(const char *data, size_t size) {
+	if(size <= buffer.size() - used) {
+		std::memcpy(buffer.data() + used, data, size);
+		used += size;
+		return;
+	}
+	// Copying a quarter of the buffer or more costs more than the extra
+	// iovec, the bytes are written straight from where they are
+	if(size >= buffer.size() / 4) {
+		iovec vectors[] = {{buffer.data(), used}, {const_cast<char*>(data), size}};
+		writeAll(vectors, 2);
+		used = 0;
+		return;
+	}
+	flush();
+	std::memcpy(buffer.data(), data, size);
+	used = size;
+}
+
+void Output::put(char c) {
+	if(used == buffer.size() ) {
+		flush();
+	}
+	buffer[used++] = c;
+}
+
+void Output::number(uint64_t value) {
+	char digits[20];
+	auto result = std::to_chars(std::begin(digits), std::end(digits), value);
+	write(digits, result.ptr - digits);
+}
+
+bool Output::flush() {
+	iovec vector = {buffer.data(), used};
+	used = 0;
+	return writeAll(&vector, 1);
+}
+
+// writev may stop short, carries on from wherever it stopped
+bool Output::writeAll(iovec *vectors, int count) {
+	while(count > 0) {
+		if(vectors->iov_len == 0) {
+			vectors++;
+			count--;
+			continue;
+		}
+		ssize_t written = writev(fd, vectors, count);
+		if(written < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			return false;
+		}
+		while(count > 0 && static_cast<size_t>(written) >= vectors->iov_len) {
+			written -= vectors->iov_len;
+			vectors++;
+			count--;
+		}
+		if(count > 0) {
+			vectors->iov_base = static_cast<char*>(vectors->iov_base) + written;
+			vectors->iov_len -= written;
+		}
+	}
+	return true;
+}
+
+bool MatchPrinter::line(Matcher &matcher, const std::string &input) {
+	const uint64_t lineOffset = offset;
+	offset += input.size() + 1;
+
+	// Whether a line matches is all a count needs, selections are never
+	// resolved and nothing is written until the end
+	if(mode == OutputMode::Count) {
+		bool matched = matcher.any(input.cbegin(), input.cend() );
+		matching += matched;
+		return matched;
+	}
+
+	// Decoding holds for the whole line, checking what is left of it before
+	// every search would be quadratic in the number of matches
+	const bool decode = matcher.decodes(input.cbegin(), input.cend() );
+	Span match, selected;
+	Iterator it = input.cbegin(), printed = input.cbegin();
+	bool matched = false;
+	int i = 1;
+	while(matcher.find(it, input.cend(), match, decode) ) {
+		matched = true;
+		if(matcher.select(match, selected) && selected.first >= printed) {
+			switch(mode) {
+				case OutputMode::Highlight:
+					write(input, printed, selected.first);
+					out.write(i++ % 2 ? Blue : Cyan);
+					write(input, selected.first, selected.last);
+					out.write(Reset);
+					break;
+				case OutputMode::Offsets:
+					out.number(lineOffset + (selected.first - input.cbegin() ) );
+					out.put('-');
+					out.number(lineOffset + (selected.last - input.cbegin() ) );
+					out.put('\n');
+					break;
+				case OutputMode::OnlyMatching:
+					write(input, selected.first, selected.last);
+					out.put('\n');
+					break;
+				case OutputMode::Count:
+					break;
+			}
+			printed = selected.last;
+		}
+		if(!Matcher::resume(it, match, input.cend() ) ) {
+			break;
+		}
+	}
+	if(mode == OutputMode::Highlight) {
+		write(input, printed, input.cend() );
+		out.put('\n');
+	}
+	matching += matched;
+	return matched;
+}
+
+void MatchPrinter::finish() {
+	if(mode == OutputMode::Count) {
+		out.number(matching);
+		out.put('\n');
+	}
+	out.flush();
+}
+
+void MatchPrinter::write(const std::string &input, Iterator first, Iterator last) {
+	out.write(input.data() + (first - input.cbegin() ), last - first);
+}
@@ -0,0 +1,68 @@
+#pragma once
+#include "matcher.hpp"
+
+#include <string_view>
+#include <vector>
+
+#include <sys/uio.h>
+#include <unistd.h>
+
+constexpr std::string_view Blue = "\x1B[93m";
+constexpr std::string_view Cyan = "\x1B[95m";
+constexpr std::string_view Reset = "\x1B[0m";
+
+// Output to a file descriptor through one large reusable buffer. Small
+// writes are gathered in the buffer, a write too large to be worth copying
+// goes out together with what is buffered in a single writev
+class Output {
+public:
+	constexpr static size_t bufferSize = 1 << 16;
+
+	explicit Output(int fd = STDOUT_FILENO) : fd(fd), buffer(bufferSize) {}
+	Output(const Output &) = delete;
+	Output &operator=(const Output &) = delete;
+	~Output() { flush(); }
+
+	void write(const char *data, size_t size);
+	void write(std::string_view str) { write(str.data(), str.size() ); }
+	void put(char c);
+	void number(uint64_t value);
+	bool flush();
+private:
+	bool writeAll(iovec *vectors, int count);
+
+	int fd;
+	std::vector<char> buffer;
+	size_t used = 0;
+};
+
+enum struct OutputMode {
+	// Every line, with the selection of every match coloured
+	Highlight,
+	// Only the number of matching lines
+	Count,
+	// first-last byte offsets of every selection in the whole input
+	Offsets,
+	// Every selection on a line of its own
+	OnlyMatching
+};
+
+// Writes what the mode asks for about the matches in a stream of lines
+class MatchPrinter {
+public:
+	MatchPrinter(Output &out, OutputMode mode) : out(out), mode(mode) {}
+	// Returns whether input, the next line of the stream, matched
+	bool line(Matcher &matcher, const std::string &input);
+	// Passes over input, the next line of the stream, without matching it
+	void skip(const std::string &input) { offset += input.size() + 1; }
+	// Writes what is only known once the stream has ended
+	void finish();
+	size_t matchingLines() const { return matching; }
+private:
+	void write(const std::string &input, Iterator first, Iterator last);
+
+	Output &out;
+	OutputMode mode;
+	uint64_t offset = 0;
+	size_t matching = 0;
+};
@@ -0,0 +1,218 @@
+#include "planner.hpp"
+#include "jit.hpp"
+#include "utf8.hpp"
+
+namespace {
+
+size_t add(size_t lhs, size_t rhs) {
+	return lhs > unbounded - rhs ? unbounded : lhs + rhs;
+}
+
+size_t multiply(size_t lhs, size_t rhs) {
+	return rhs != 0 && lhs > unbounded / rhs ? unbounded : lhs * rhs;
+}
+
+// Collects the properties of node into properties, lengths and
+// alternatives describe node alone. Literals only come from strings every
+// match has to pass through: eithers and \I contribute none
+void analyse(Node *node, bool required, PatternProperties &properties, size_t &minLength,
+		size_t &maxLength, size_t &alternatives) {
+	if(auto string = dynamic_cast<NodeString*>(node) ) {
+		if(required) {
+			properties.literals.push_back(string->value);
+		}
+		minLength = maxLength = string->value.size();
+		alternatives = 1;
+		return;
+	}
+
+	if(dynamic_cast<NodeWildcard*>(node) ) {
+		minLength = maxLength = alternatives = 1;
+		return;
+	}
+
+	if(dynamic_cast<NodeEither*>(node) ) {
+		minLength = unbounded;
+		maxLength = alternatives = 0;
+		for(auto &child : node->children) {
+			size_t childMin, childMax, childAlternatives;
+			analyse(child.get(), false, properties, childMin, childMax, childAlternatives);
+			minLength = std::min(minLength, childMin);
+			maxLength = std::max(maxLength, childMax);
+			alternatives = add(alternatives, childAlternatives);
+		}
+		return;
+	}
+
+	if(dynamic_cast<NodeSequence*>(node) ) {
+		minLength = maxLength = 0;
+		alternatives = 1;
+		for(auto &child : node->children) {
+			size_t childMin, childMax, childAlternatives;
+			analyse(child.get(), required, properties, childMin, childMax, childAlternatives);
+			minLength = add(minLength, childMin);
+			maxLength = add(maxLength, childMax);
+			alternatives = multiply(alternatives, childAlternatives);
+		}
+		return;
+	}
+
+	if(auto counter = dynamic_cast<NodeCounter*>(node) ) {
+		// A counter of zero never evaluates its child
+		const size_t times = std::max(counter->value, 0);
+		properties.largestCount = std::max(properties.largestCount, times);
+		analyse(node->children.front().get(), required && times > 0, properties,
+			minLength, maxLength, alternatives);
+		minLength = multiply(minLength, times);
+		maxLength = multiply(maxLength, times);
+		return;
+	}
+
+	if(dynamic_cast<NodeCaseInsensitive*>(node) ) {
+		properties.caseInsensitive = true;
+		analyse(node->children.front().get(), false, properties, minLength, maxLength, alternatives);
+		return;
+	}
+
+	// Groupings and selections match what their child matches, a repeated
+	// child matches at least once
+	analyse(node->children.front().get(), required, properties, minLength, maxLength, alternatives);
+	if(dynamic_cast<NodeRepeated*>(node) ) {
+		maxLength = unbounded;
+	}
+}
+
+// A sequence of one string outside \I, the only patterns a substring search
+// can stand in for
+bool isLiteral(Node *root) {
+	return dynamic_cast<NodeSequence*>(root) && root->children.size() == 1
+		&& dynamic_cast<NodeString*>(root->children.front().get() );
+}
+
+bool foldsNonAscii(Node *node, bool folded) {
+	if(auto string = dynamic_cast<NodeString*>(node) ) {
+		return folded && !isAscii(string->value.data(), string->value.data() + string->value.size() );
+	}
+	folded |= dynamic_cast<NodeCaseInsensitive*>(node) != nullptr;
+	for(auto &child : node->children) {
+		if(foldsNonAscii(child.get(), folded) ) {
+			return true;
+		}
+	}
+	return false;
+}
+
+size_t countNodes(Node *root) {
+	size_t count = 0;
+	std::vector<Node*> stack = {root};
+	while(!stack.empty() ) {
+		Node *node = stack.back();
+		stack.pop_back();
+		count++;
+		for(auto &child : node->children) {
+			stack.push_back(child.get() );
+		}
+	}
+	return count;
+}
+
+}
+
+const char *engineName(Engine engine) {
+	switch(engine) {
+		case Engine::Literal:
+			return "literal";
+		case Engine::ShiftAnd:
+			return "shift-and";
+		case Engine::Jit:
+			return "jit";
+		case Engine::Backtrack:
+			return "backtrack";
+	}
+	return "unknown";
+}
+
+Plan planPattern(Node *root, unsigned groupCount, const ShiftAnd &bitap, bool utf8) {
+	Plan plan;
+	PatternProperties &properties = plan.properties;
+	analyse(root, true, properties, properties.minLength, properties.maxLength, properties.alternatives);
+	properties.selects = dynamic_cast<NodeSelectionGroup*>(root) != nullptr;
+	properties.captures = groupCount;
+	properties.foldsNonAscii = foldsNonAscii(root, false);
+	for(auto &literal : properties.literals) {
+		if(literal.size() > plan.literal.size() ) {
+			plan.literal = literal;
+		}
+	}
+
+	// Costs are rough per byte estimates. A substring search skips most
+	// bytes, Shift-And does a shift, an or and an and per byte. The
+	// backtracker calls eval() for a share of the nodes at every start
+	// position, once per way through the eithers
+	const bool literal = isLiteral(root);
+	plan.choices.push_back(EngineChoice{Engine::Literal, literal, 0.25,
+		literal ? "one case sensitive string" : "not a single case sensitive string"});
+
+	// The byte table folds ASCII only, in UTF-8 mode it would miss ASCII
+	// subjects that match by folding a code point of the pattern
+	const bool bitParallel = bitap.length() > 0 && !(utf8 && properties.foldsNonAscii);
+	plan.choices.push_back(EngineChoice{Engine::ShiftAnd, bitParallel, 1.0,
+		bitParallel ? "fixed sequence of at most 64 character classes"
+			: bitap.length() > 0 ? "folds code points outside ASCII"
+			: "not a fixed sequence of at most 64 character classes"});
+
+	const double work = 2.0 * countNodes(root) * std::min<size_t>(properties.alternatives, 1 << 20);
+	plan.choices.push_back(EngineChoice{Engine::Backtrack, true, work,
+		properties.selects ? "matches anything, resolves \\O{n}" : "matches anything"});
+
+	const EngineChoice *best = nullptr;
+	for(auto &choice : plan.choices) {
+		if(choice.eligible && (!best || choice.cost < best->cost) ) {
+			best = &choice;
+		}
+	}
+	plan.engine = best->engine;
+	return plan;
+}
+
+std::ostream &operator<<(std::ostream &os, const Plan &plan) {
+	const PatternProperties &properties = plan.properties;
+	os << "Length: " << properties.minLength << " to ";
+	if(properties.maxLength == unbounded) {
+		os << "unbounded\n";
+	} else {
+		os << properties.maxLength << '\n';
+	}
+	os << "Alternatives: ";
+	if(properties.alternatives == unbounded) {
+		os << "unbounded\n";
+	} else {
+		os << properties.alternatives << '\n';
+	}
+	os << "Captures: " << properties.captures << (properties.selects ? ", selects" : "") << '\n';
+	os << "Case insensitive: " << (properties.caseInsensitive ? "yes" : "no") << '\n';
+	os << "Literals:";
+	for(auto &literal : properties.literals) {
+		os << " \"" << literal << '"';
+	}
+	os << '\n';
+
+	for(auto &choice : plan.choices) {
+		os << (choice.engine == plan.engine ? "* " : "  ") << engineName(choice.engine) << ": ";
+		if(choice.eligible) {
+			os << "cost " << choice.cost << ", ";
+		} else {
+			os << "not eligible, ";
+		}
+		os << choice.reason << '\n';
+	}
+	if(plan.engine == Engine::ShiftAnd && JitScanner::supported) {
+		os << "  jit: replaces shift-and once the pattern is hot\n";
+	}
+	// Listed so that nobody goes looking for one
+	os << "  dfa: not available, there is no DFA engine\n";
+	if(plan.engine == Engine::Backtrack && !plan.literal.empty() ) {
+		os << "Subjects without \"" << plan.literal << "\" are skipped\n";
+	}
+	return os;
+}
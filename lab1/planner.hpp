@@ -0,0 +1,67 @@
+#pragma once
+#include "node.hpp"
+#include "shiftand.hpp"
+
+#include <cstdint>
+
+// Ways of locating the bounds of a match, cheapest first
+enum struct Engine {
+	// Substring search for a pattern that is one case sensitive string
+	Literal,
+	// Shift-And over a fixed sequence of at most 64 character classes
+	ShiftAnd,
+	// Native code for a Shift-And pattern, never planned, a matcher promotes
+	// its Shift-And pattern once it is hot
+	Jit,
+	// Node::eval(), matches everything
+	Backtrack
+};
+
+const char *engineName(Engine engine);
+
+constexpr size_t unbounded = SIZE_MAX;
+
+struct PatternProperties {
+	// Strings that every match contains, compared case sensitively
+	std::vector<std::string> literals;
+	size_t minLength = 0;
+	// unbounded once a repetition is involved
+	size_t maxLength = 0;
+	// Largest count of a counter. A counter checks that as many bytes are
+	// left before trying its child, the backtracker can look that far past
+	// the end of the longest match
+	size_t largestCount = 0;
+	// Number of ways through the eithers of the pattern
+	size_t alternatives = 1;
+	bool caseInsensitive = false;
+	// A string under \I has bytes outside ASCII. Folding the code points
+	// they encode can end in ASCII, U+017F to s, which only decoding knows
+	bool foldsNonAscii = false;
+	bool selects = false;
+	unsigned captures = 0;
+};
+
+struct EngineChoice {
+	Engine engine;
+	bool eligible;
+	// Estimated work per byte of subject, only meaningful when eligible
+	double cost;
+	const char *reason;
+};
+
+struct Plan {
+	PatternProperties properties;
+	std::vector<EngineChoice> choices;
+	Engine engine = Engine::Backtrack;
+	// The string searched for by Literal, and the literal the backtracker
+	// checks for before trying a subject. Empty if there is none
+	std::string literal;
+};
+
+// Analyses the tree of a parsed pattern and picks the eligible engine with
+// the lowest cost. bitap is the Shift-And matcher already compiled from root,
+// utf8 plans for matching code points
+Plan planPattern(Node *root, unsigned groupCount, const ShiftAnd &bitap, bool utf8 = false);
+
+// Explains the properties found and why the engine was chosen
+std::ostream &operator<<(std::ostream &os, const Plan &plan);
@@ -0,0 +1,352 @@
+#include "program.hpp"
+#include "evaluate.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <thread>
+
+namespace {
+
+unsigned arity(NodeKind::Type kind) {
+	switch(kind) {
+		case NodeKind::String:
+		case NodeKind::Wildcard:
+			return 0;
+	}
+	return 1;
+}
+
+}
+
+bool ProgramWriter::add(const std::string &pattern) {
+	Child root = parser.parseTokens(tokenizer.tokenize(pattern) );
+	if(!root) {
+		return false;
+	}
+
+	ProgramPattern entry{};
+	entry.source = store(pattern);
+	entry.sourceLength = pattern.size();
+	entry.root = flatten(root.get() );
+	entry.groups = parser.groups();
+	if(auto selectionGroup = dynamic_cast<NodeSelectionGroup*>(root.get() ) ) {
+		entry.selection = selectionGroup->value;
+	}
+	entry.table = ProgramFormat::noTable;
+	ShiftAnd bitap;
+	if(bitap.compile(root.get() ) ) {
+		entry.table = tables.size();
+		entry.tableLength = bitap.length();
+		tables.emplace_back();
+		std::copy(bitap.table(), bitap.table() + 256, tables.back().begin() );
+	}
+	patterns.push_back(entry);
+	return true;
+}
+
+std::vector<size_t> ProgramWriter::addAll(const std::vector<std::string> &sources, unsigned threads) {
+	threads = std::max(1u, std::min<unsigned>(threads, sources.size() / 64 + 1) );
+	std::vector<ProgramWriter> slices;
+	std::vector<std::vector<size_t>> failures(threads);
+	slices.reserve(threads);
+	for(unsigned i = 0; i < threads; i++) {
+		slices.emplace_back(maxDepth);
+	}
+
+	// Contiguous slices keep the patterns in order once merged
+	auto compileSlice = [&](unsigned slice) {
+		const size_t first = sources.size() * slice / threads;
+		const size_t last = sources.size() * (slice + 1) / threads;
+		for(size_t i = first; i < last; i++) {
+			if(!slices[slice].add(sources[i]) ) {
+				failures[slice].push_back(i);
+			}
+		}
+	};
+	std::vector<std::thread> workers;
+	for(unsigned i = 1; i < threads; i++) {
+		workers.emplace_back(compileSlice, i);
+	}
+	compileSlice(0);
+	for(auto &worker : workers) {
+		worker.join();
+	}
+
+	std::vector<size_t> failed;
+	for(unsigned i = 0; i < threads; i++) {
+		merge(slices[i]);
+		failed.insert(failed.end(), failures[i].begin(), failures[i].end() );
+	}
+	return failed;
+}
+
+void ProgramWriter::merge(const ProgramWriter &other) {
+	// The nodes a pattern added are the ones after those of the patterns
+	// before it, up to its root. Storing them pattern by pattern, after the
+	// source like add() does, writes the same file whichever way the
+	// patterns were split between threads
+	std::vector<uint32_t> translated(other.nodes.size() );
+	std::vector<uint32_t> kids;
+	size_t next = 0;
+	for(ProgramPattern entry : other.patterns) {
+		entry.source = store(std::string_view(other.strings).substr(entry.source, entry.sourceLength) );
+		for(; next <= entry.root; next++) {
+			const ProgramNode &node = other.nodes[next];
+			kids.clear();
+			for(uint32_t c = 0; c < node.childCount; c++) {
+				kids.push_back(translated[other.children[node.firstChild + c]]);
+			}
+			translated[next] = intern(node, kids.data(),
+				std::string_view(other.strings).substr(node.string, node.stringLength) );
+		}
+		entry.root = translated[entry.root];
+		if(entry.table != ProgramFormat::noTable) {
+			tables.push_back(other.tables[entry.table]);
+			entry.table = tables.size() - 1;
+		}
+		patterns.push_back(entry);
+	}
+	parsed += other.parsed;
+}
+
+uint64_t ProgramWriter::store(std::string_view str) {
+	auto [found, added] = stored.try_emplace(std::string(str), strings.size() );
+	if(added) {
+		strings += str;
+	}
+	return found->second;
+}
+
+// Children are flattened first, so that every child index is lower than the
+// index of its parent
+uint32_t ProgramWriter::flatten(Node *node) {
+	std::vector<uint32_t> indices;
+	indices.reserve(node->children.size() );
+	for(auto &child : node->children) {
+		indices.push_back(flatten(child.get() ) );
+	}
+
+	ProgramNode flat{};
+	std::string_view string;
+	if(dynamic_cast<NodeSequence*>(node) ) {
+		flat.kind = NodeKind::Sequence;
+	} else if(auto selectionGroup = dynamic_cast<NodeSelectionGroup*>(node) ) {
+		flat.kind = NodeKind::SelectionGroup;
+		flat.value = selectionGroup->value;
+	} else if(auto grouping = dynamic_cast<NodeGrouping*>(node) ) {
+		flat.kind = NodeKind::Grouping;
+		flat.value = grouping->index;
+	} else if(dynamic_cast<NodeCaseInsensitive*>(node) ) {
+		flat.kind = NodeKind::CaseInsensitive;
+	} else if(dynamic_cast<NodeRepeated*>(node) ) {
+		flat.kind = NodeKind::Repeated;
+	} else if(dynamic_cast<NodeEither*>(node) ) {
+		flat.kind = NodeKind::Either;
+	} else if(auto counter = dynamic_cast<NodeCounter*>(node) ) {
+		flat.kind = NodeKind::Counter;
+		flat.value = counter->value;
+	} else if(auto stringNode = dynamic_cast<NodeString*>(node) ) {
+		flat.kind = NodeKind::String;
+		string = stringNode->value;
+	} else {
+		flat.kind = NodeKind::Wildcard;
+	}
+	flat.childCount = indices.size();
+	parsed++;
+	return intern(flat, indices.data(), string);
+}
+
+// The key is everything that makes a node what it is: kind, value, the
+// bytes of its string and its children, which are interned already
+uint32_t ProgramWriter::intern(ProgramNode flat, const uint32_t *kids, std::string_view string) {
+	std::string key;
+	key.reserve(1 + sizeof(flat.value) + (flat.childCount + 1) * sizeof(uint32_t) + string.size() );
+	key.push_back(flat.kind);
+	key.append(reinterpret_cast<const char*>(&flat.value), sizeof(flat.value) );
+	key.append(reinterpret_cast<const char*>(&flat.childCount), sizeof(flat.childCount) );
+	key.append(reinterpret_cast<const char*>(kids), flat.childCount * sizeof(uint32_t) );
+	key.append(string);
+
+	auto [found, added] = interned.try_emplace(std::move(key), nodes.size() );
+	if(!added) {
+		return found->second;
+	}
+	flat.firstChild = children.size();
+	children.insert(children.end(), kids, kids + flat.childCount);
+	flat.string = string.empty() ? 0 : store(string);
+	flat.stringLength = string.size();
+	nodes.push_back(flat);
+	return found->second;
+}
+
+bool ProgramWriter::write(const std::string &path) const {
+	ProgramHeader header{};
+	std::copy(std::begin(ProgramFormat::magic), std::end(ProgramFormat::magic), header.magic);
+	header.version = ProgramFormat::version;
+	header.byteOrder = ProgramFormat::byteOrder;
+	header.patternCount = patterns.size();
+	header.nodeCount = nodes.size();
+	header.childCount = children.size();
+	header.tableCount = tables.size();
+	header.stringSize = strings.size();
+	header.patterns = align(sizeof(ProgramHeader) );
+	header.nodes = align(header.patterns + patterns.size() * sizeof(ProgramPattern) );
+	header.children = align(header.nodes + nodes.size() * sizeof(ProgramNode) );
+	header.tables = align(header.children + children.size() * sizeof(uint32_t) );
+	header.strings = align(header.tables + tables.size() * sizeof(tables.front() ) );
+	header.size = header.strings + strings.size();
+
+	std::string image(header.size, '\0');
+	auto place = [&image](uint64_t offset, const void *data, size_t size) {
+		if(size > 0) {
+			std::memcpy(&image[offset], data, size);
+		}
+	};
+	place(header.patterns, patterns.data(), patterns.size() * sizeof(ProgramPattern) );
+	place(header.nodes, nodes.data(), nodes.size() * sizeof(ProgramNode) );
+	place(header.children, children.data(), children.size() * sizeof(uint32_t) );
+	place(header.tables, tables.data(), tables.size() * sizeof(tables.front() ) );
+	place(header.strings, strings.data(), strings.size() );
+	header.checksum = checksum(image.data() + sizeof(ProgramHeader), image.data() + image.size() );
+	place(0, &header, sizeof(ProgramHeader) );
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(image.data(), image.size() );
+	return static_cast<bool>(file);
+}
+
+bool Program::map(const std::string &path) {
+	if(const char *why = file.map(path) ) {
+		return fail(why);
+	}
+	if(file.size() < sizeof(ProgramHeader) ) {
+		return fail("file too small");
+	}
+	base = file.data();
+	length = file.size();
+	header = reinterpret_cast<const ProgramHeader*>(base);
+	return validate();
+}
+
+void Program::printErr() const {
+	std::cerr << "Bad program file: " << (error ? error : "not mapped") << '\n';
+}
+
+bool Program::fail(const char *why) {
+	error = why;
+	header = nullptr;
+	return false;
+}
+
+bool Program::validate() {
+	if(!std::equal(std::begin(ProgramFormat::magic), std::end(ProgramFormat::magic), header->magic) ) {
+		return fail("not a program file");
+	}
+	if(header->byteOrder != ProgramFormat::byteOrder) {
+		return fail("wrong byte order");
+	}
+	if(header->version != ProgramFormat::version) {
+		return fail("unsupported version");
+	}
+	if(header->size != length) {
+		return fail("truncated");
+	}
+	if(header->checksum != checksum(base + sizeof(ProgramHeader), base + length) ) {
+		return fail("checksum mismatch");
+	}
+	if(!fits(header->patterns, header->patternCount, sizeof(ProgramPattern), length)
+		|| !fits(header->nodes, header->nodeCount, sizeof(ProgramNode), length)
+		|| !fits(header->children, header->childCount, sizeof(uint32_t), length)
+		|| !fits(header->tables, header->tableCount, 256 * sizeof(uint64_t), length)
+		|| header->strings > length || header->stringSize > length - header->strings) {
+		return fail("section out of bounds");
+	}
+
+	patterns = reinterpret_cast<const ProgramPattern*>(base + header->patterns);
+	nodes = reinterpret_cast<const ProgramNode*>(base + header->nodes);
+	children = reinterpret_cast<const uint32_t*>(base + header->children);
+	tables = reinterpret_cast<const uint64_t*>(base + header->tables);
+	strings = base + header->strings;
+
+	// A checksum only catches accidents, the references are checked as well
+	// so that evaluation can trust them. Pointing children backwards keeps the
+	// node graph acyclic, groupings records how many groupings a node writes
+	// and depths how deep evaluation recurses below it. The parser allows a
+	// sequence, a chain of unary operators and an either per level of nesting
+	constexpr uint32_t maxDepth = 3 * defaultMaxDepth;
+	std::vector<uint32_t> groupings(header->nodeCount, 0);
+	std::vector<uint32_t> depths(header->nodeCount, 1);
+	for(uint32_t i = 0; i < header->nodeCount; i++) {
+		const ProgramNode &node = nodes[i];
+		if(node.kind > NodeKind::Wildcard
+			|| node.firstChild > header->childCount
+			|| node.childCount > header->childCount - node.firstChild
+			|| (node.kind == NodeKind::Sequence ? node.childCount == 0
+				: node.kind == NodeKind::Either ? node.childCount < 2
+				: node.childCount != arity(node.kind) )
+			|| node.string > header->stringSize
+			|| node.stringLength > header->stringSize - node.string
+			|| (node.kind == NodeKind::Grouping && node.value < 0) ) {
+			return fail("malformed node");
+		}
+		if(node.kind == NodeKind::Grouping) {
+			groupings[i] = node.value + 1;
+		}
+		for(uint32_t c = 0; c < node.childCount; c++) {
+			const uint32_t child = children[node.firstChild + c];
+			if(child >= i) {
+				return fail("malformed node");
+			}
+			groupings[i] = std::max(groupings[i], groupings[child]);
+			depths[i] = std::max(depths[i], depths[child] + 1);
+		}
+		if(depths[i] > maxDepth) {
+			return fail("nests too deep");
+		}
+	}
+
+	for(uint32_t i = 0; i < header->patternCount; i++) {
+		const ProgramPattern &entry = patterns[i];
+		if(entry.root >= header->nodeCount
+			|| entry.groups < groupings[entry.root]
+			|| entry.groups > header->nodeCount
+			|| entry.source > header->stringSize
+			|| entry.sourceLength > header->stringSize - entry.source
+			|| (entry.table != ProgramFormat::noTable
+				&& (entry.table >= header->tableCount || entry.tableLength == 0
+					|| entry.tableLength > ShiftAnd::maxLength) ) ) {
+			return fail("malformed pattern");
+		}
+	}
+	return true;
+}
+
+std::string_view Program::source(size_t index) const {
+	return std::string_view(strings + patterns[index].source, patterns[index].sourceLength);
+}
+
+bool Program::eval(uint32_t index) const {
+	const ProgramNode &node = nodes[index];
+	const uint32_t *child = children + node.firstChild;
+	switch(node.kind) {
+		case NodeKind::Sequence:
+			return evalPlane(node.childCount, [this, child](size_t i) { return eval(child[i]); });
+		case NodeKind::SelectionGroup:
+			return evalSelectionGroup(node.value, [this, child] { return eval(child[0]); });
+		case NodeKind::Grouping:
+			return evalGrouping(node.value, [this, child] { return eval(child[0]); });
+		case NodeKind::CaseInsensitive:
+			return evalCaseInsensitive([this, child] { return eval(child[0]); });
+		case NodeKind::Repeated:
+			return evalRepeated([this, child] { return eval(child[0]); });
+		case NodeKind::Either:
+			return evalEither(node.childCount, [this, child](size_t i) { return eval(child[i]); });
+		case NodeKind::Counter:
+			return evalCounter(node.value, [this, child] { return eval(child[0]); });
+		case NodeKind::String:
+			return evalString(strings + node.string, node.stringLength);
+		case NodeKind::Wildcard:
+			return evalWildcard();
+	}
+	return false;
+}
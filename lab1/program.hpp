@@ -0,0 +1,153 @@
+#pragma once
+#include "mapped.hpp"
+#include "node.hpp"
+#include "shiftand.hpp"
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+// Compiled pattern files. A file holds the parsed trees of a list of patterns
+// as a flat node table plus the Shift-And tables of the patterns that have
+// one. Every reference inside the file is an index or an offset from the
+// start of the file, so it can be mapped read-only at any address, shared
+// between processes and evaluated in place without building any Node
+//
+// Layout, every section starts on an 8 byte boundary:
+//   ProgramHeader
+//   ProgramPattern[patternCount]
+//   ProgramNode[nodeCount]       children always precede their parents
+//   uint32_t[childCount]         child node indices, a run per node
+//   uint64_t[256][tableCount]    Shift-And masks
+//   char[stringSize]             pattern sources and string values
+
+namespace ProgramFormat {
+	constexpr char magic[8] = {'L', '1', 'P', 'R', 'O', 'G', '\0', '\0'};
+	constexpr uint32_t version = 1;
+	// Written as is, a file from a machine of the other byte order reads back
+	// swapped and is rejected
+	constexpr uint32_t byteOrder = 0x01020304;
+	constexpr uint32_t noTable = UINT32_MAX;
+};
+
+namespace NodeKind {
+	using Type = uint8_t;
+	constexpr Type Sequence			= 0;
+	constexpr Type SelectionGroup	= 1;
+	constexpr Type Grouping			= 2;
+	constexpr Type CaseInsensitive	= 3;
+	constexpr Type Repeated			= 4;
+	constexpr Type Either			= 5;
+	constexpr Type Counter			= 6;
+	constexpr Type String			= 7;
+	constexpr Type Wildcard			= 8;
+};
+
+struct ProgramHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	// Size of the whole file and FNV-1a over everything after the header
+	uint64_t size;
+	uint64_t checksum;
+	uint32_t patternCount;
+	uint32_t nodeCount;
+	uint32_t childCount;
+	uint32_t tableCount;
+	uint64_t stringSize;
+	uint64_t patterns;
+	uint64_t nodes;
+	uint64_t children;
+	uint64_t tables;
+	uint64_t strings;
+};
+
+struct ProgramPattern {
+	uint64_t source;
+	uint32_t sourceLength;
+	uint32_t root;
+	uint32_t groups;
+	int32_t selection;
+	uint32_t table;
+	uint32_t tableLength;
+};
+
+struct ProgramNode {
+	NodeKind::Type kind;
+	uint8_t reserved[3];
+	// Counter, selection group or grouping index
+	int32_t value;
+	uint32_t firstChild;
+	uint32_t childCount;
+	uint64_t string;
+	uint64_t stringLength;
+};
+
+// Builds a compiled pattern file from pattern sources. Nodes are hash-consed:
+// a node with the kind, value, string and children of one already stored is
+// not stored again, so a subtree that several patterns, or one pattern
+// several times, contain is held once. The node table becomes a DAG, which
+// the format allows as children only have to precede their parents. Strings
+// are stored once as well
+class ProgramWriter {
+public:
+	explicit ProgramWriter(unsigned maxDepth = defaultMaxDepth) : maxDepth(maxDepth), parser(maxDepth) {}
+	// Returns false, adding nothing, if the pattern does not parse
+	bool add(const std::string &pattern);
+	// Adds every pattern that parses, in order, parsing and flattening slices
+	// of them on up to threads threads. Returns the indices of the patterns
+	// that do not parse
+	std::vector<size_t> addAll(const std::vector<std::string> &sources, unsigned threads);
+	bool write(const std::string &path) const;
+	size_t size() const { return patterns.size(); }
+	// Nodes of every tree added, and the nodes stored for them
+	size_t nodesParsed() const { return parsed; }
+	size_t nodesStored() const { return nodes.size(); }
+private:
+	uint32_t flatten(Node *node);
+	uint32_t intern(ProgramNode flat, const uint32_t *kids, std::string_view string);
+	uint64_t store(std::string_view str);
+	// Adds what another writer holds, interning its nodes and strings
+	void merge(const ProgramWriter &other);
+
+	unsigned maxDepth;
+	Tokenizer tokenizer;
+	Parser parser;
+	std::vector<ProgramPattern> patterns;
+	std::vector<ProgramNode> nodes;
+	std::vector<uint32_t> children;
+	std::vector<std::array<uint64_t, 256>> tables;
+	std::string strings;
+	std::unordered_map<std::string, uint32_t> interned;
+	std::unordered_map<std::string, uint64_t> stored;
+	size_t parsed = 0;
+};
+
+// A compiled pattern file mapped read-only. Only the header and the node
+// references are checked when mapping, nothing is copied out of the file
+class Program {
+public:
+	bool map(const std::string &path);
+	void printErr() const;
+
+	size_t size() const { return header ? header->patternCount : 0; }
+	const ProgramPattern &pattern(size_t index) const { return patterns[index]; }
+	std::string_view source(size_t index) const;
+	// Evaluates node against the global state, exactly like Node::eval()
+	bool eval(uint32_t node) const;
+	const uint64_t *table(uint32_t index) const { return tables + index * 256; }
+private:
+	bool fail(const char *why);
+	bool validate();
+
+	MappedFile file;
+	const char *base = nullptr;
+	size_t length = 0;
+	const ProgramHeader *header = nullptr;
+	const ProgramPattern *patterns = nullptr;
+	const ProgramNode *nodes = nullptr;
+	const uint32_t *children = nullptr;
+	const uint64_t *tables = nullptr;
+	const char *strings = nullptr;
+	const char *error = nullptr;
+};
@@ -0,0 +1,395 @@
+#include "server.hpp"
+
+#include <cerrno>
+#include <csignal>
+#include <cstring>
+#include <functional>
+#include <iostream>
+
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+namespace {
+
+// Reserved epoll ids, connections are numbered after them
+constexpr uint64_t listenId = 0, signalId = 1, answersId = 2;
+
+// The line a request gets back, the selections as MatchPrinter writes them
+// in its offsets mode but relative to the subject
+std::string respond(Matcher &matcher, const std::string &subject) {
+	std::string text = "0";
+	Span match, selected;
+	Iterator it = subject.cbegin(), taken = subject.cbegin();
+	while(matcher.find(it, subject.cend(), match) ) {
+		text[0] = '1';
+		if(matcher.select(match, selected) && selected.first >= taken) {
+			text += ' ';
+			text += std::to_string(selected.first - subject.cbegin() );
+			text += '-';
+			text += std::to_string(selected.last - subject.cbegin() );
+			taken = selected.last;
+		}
+		if(!Matcher::resume(it, match, subject.cend() ) ) {
+			break;
+		}
+	}
+	return text;
+}
+
+}
+
+Server::Server(unsigned workerCount) : nextId(answersId + 1) {
+	for(unsigned i = 0; i < std::max(workerCount, 1u); i++) {
+		workers.push_back(std::make_unique<Worker>() );
+	}
+}
+
+Server::~Server() {
+	for(auto &[id, connection] : connections) {
+		::close(connection.fd);
+	}
+	for(int fd : {listenFd, signalFd, answersFd, epollFd}) {
+		if(fd >= 0) {
+			::close(fd);
+		}
+	}
+	if(!path.empty() ) {
+		unlink(path.c_str() );
+	}
+}
+
+const char *Server::listen(const std::string &socketPath) {
+	sockaddr_un address = {};
+	address.sun_family = AF_UNIX;
+	if(socketPath.size() >= sizeof(address.sun_path) ) {
+		return "the path is too long for a socket";
+	}
+	std::memcpy(address.sun_path, socketPath.c_str(), socketPath.size() + 1);
+
+	// Only a socket is ever removed, never a file that happens to be there
+	struct stat status;
+	if(lstat(socketPath.c_str(), &status) == 0 && S_ISSOCK(status.st_mode) ) {
+		unlink(socketPath.c_str() );
+	}
+
+	listenFd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+	if(listenFd < 0) {
+		return std::strerror(errno);
+	}
+	if(bind(listenFd, reinterpret_cast<sockaddr*>(&address), sizeof(address) ) != 0) {
+		return std::strerror(errno);
+	}
+	path = socketPath;
+	if(::listen(listenFd, SOMAXCONN) != 0) {
+		return std::strerror(errno);
+	}
+	return nullptr;
+}
+
+bool Server::run() {
+	// Blocked before the workers start so that they inherit the mask and the
+	// signals are only ever read from signalFd
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+	pthread_sigmask(SIG_BLOCK, &signals, nullptr);
+	signalFd = signalfd(-1, &signals, SFD_NONBLOCK | SFD_CLOEXEC);
+	answersFd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+	epollFd = epoll_create1(EPOLL_CLOEXEC);
+	if(listenFd < 0 || signalFd < 0 || answersFd < 0 || epollFd < 0) {
+		std::cerr << "Cannot serve: " << std::strerror(errno) << '\n';
+		return false;
+	}
+	const std::pair<int, uint64_t> watched[] = {{listenFd, listenId}, {signalFd, signalId}, {answersFd, answersId}};
+	for(auto [fd, id] : watched) {
+		epoll_event event = {};
+		event.events = EPOLLIN;
+		event.data.u64 = id;
+		epoll_ctl(epollFd, EPOLL_CTL_ADD, fd, &event);
+	}
+
+	for(auto &worker : workers) {
+		worker->thread = std::thread(&Server::work, this, std::ref(*worker) );
+	}
+	std::cerr << "Serving on " << path << " with " << workers.size() << " workers\n";
+
+	const auto started = Clock::now();
+	bool stopping = false;
+	epoll_event events[64];
+	while(!stopping) {
+		int ready = epoll_wait(epollFd, events, std::size(events), -1);
+		if(ready < 0 && errno != EINTR) {
+			std::cerr << "epoll_wait: " << std::strerror(errno) << '\n';
+			break;
+		}
+		for(int i = 0; i < ready; i++) {
+			const uint64_t id = events[i].data.u64;
+			if(id == listenId) {
+				accept();
+			} else if(id == signalId) {
+				stopping = true;
+			} else if(id == answersId) {
+				deliver();
+			} else if(connections.count(id) ) {
+				// The peer is gone or broken, answers could not reach it
+				if(events[i].events & (EPOLLERR | EPOLLHUP) ) {
+					close(id);
+					continue;
+				}
+				// Either may close the connection
+				if(events[i].events & EPOLLIN) {
+					read(id, connections.at(id) );
+				}
+				if(events[i].events & EPOLLOUT && connections.count(id) ) {
+					flush(id, connections.at(id) );
+				}
+			}
+		}
+		dispatch();
+	}
+	const auto elapsed = std::chrono::duration<double>(Clock::now() - started).count();
+
+	for(auto &worker : workers) {
+		{
+			std::lock_guard lock(worker->mutex);
+			worker->stopping = true;
+		}
+		worker->ready.notify_one();
+		worker->thread.join();
+	}
+
+	std::cerr << "Served " << requests << " requests in " << batches << " batches from "
+		<< accepted << " connections in " << elapsed << " s, "
+		<< static_cast<uint64_t>(requests / std::max(elapsed, 1e-9) ) << " requests/s\n"
+		<< "Latency from read to answer: " << latencies;
+	return true;
+}
+
+void Server::accept() {
+	int fd;
+	while( (fd = accept4(listenFd, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC) ) >= 0) {
+		const uint64_t id = nextId++;
+		Connection &connection = connections[id];
+		connection.fd = fd;
+		accepted++;
+		watch(id, connection);
+	}
+}
+
+// Reads a chunk at a time until the connection is full, what is left stays
+// in the socket until watch() asks for it again
+void Server::read(uint64_t id, Connection &connection) {
+	char chunk[1 << 16];
+	while(!full(connection) ) {
+		const ssize_t got = ::read(connection.fd, chunk, sizeof(chunk) );
+		if(got == 0) {
+			connection.draining = true;
+			break;
+		}
+		if(got < 0) {
+			if(errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR) {
+				close(id);
+				return;
+			}
+			break;
+		}
+		connection.in.append(chunk, got);
+
+		size_t start = 0, end;
+		while( (end = connection.in.find('\n', start) ) != std::string::npos) {
+			request(id, connection, std::string_view(connection.in).substr(start, end - start) );
+			start = end + 1;
+		}
+		connection.in.erase(0, start);
+		if(connection.in.size() > maxLine) {
+			close(id);
+			return;
+		}
+		if(got < static_cast<ssize_t>(sizeof(chunk) ) ) {
+			break;
+		}
+	}
+	// Requests read so far may already be answered, a connection that is
+	// draining has to be closed once they are
+	flush(id, connection);
+}
+
+void Server::request(uint64_t id, Connection &connection, std::string_view line) {
+	const uint64_t sequence = connection.next++;
+	connection.slots.emplace_back();
+	requests++;
+	const auto tab = line.find('\t');
+	if(tab == std::string_view::npos) {
+		answer(connection, sequence, "! no tab between pattern and subject");
+		return;
+	}
+	std::string pattern(line.substr(0, tab) );
+	Batch &batch = pending[pattern];
+	if(batch.jobs.empty() ) {
+		batch.pattern = std::move(pattern);
+	}
+	batch.jobs.push_back(Job{id, sequence, std::string(line.substr(tab + 1) ), Clock::now()});
+}
+
+void Server::answer(Connection &connection, uint64_t sequence, std::string text) {
+	connection.slots[sequence - connection.first] = std::move(text);
+	while(!connection.slots.empty() && connection.slots.front() ) {
+		connection.out += *connection.slots.front();
+		connection.out += '\n';
+		connection.slots.pop_front();
+		connection.first++;
+	}
+}
+
+void Server::deliver() {
+	uint64_t signalled;
+	while(::read(answersFd, &signalled, sizeof(signalled) ) > 0) {
+	}
+	std::vector<Answer> done;
+	{
+		std::lock_guard lock(answersMutex);
+		done.swap(answers);
+	}
+	const auto now = Clock::now();
+	std::vector<uint64_t> touched;
+	for(Answer &answered : done) {
+		latencies.record(now - answered.arrived);
+		auto found = connections.find(answered.connection);
+		// Answers to a connection closed in the meantime are dropped
+		if(found == connections.end() ) {
+			continue;
+		}
+		answer(found->second, answered.sequence, std::move(answered.text) );
+		if(touched.empty() || touched.back() != answered.connection) {
+			touched.push_back(answered.connection);
+		}
+	}
+	for(uint64_t id : touched) {
+		if(auto found = connections.find(id); found != connections.end() ) {
+			flush(id, found->second);
+		}
+	}
+}
+
+void Server::flush(uint64_t id, Connection &connection) {
+	while(connection.written < connection.out.size() ) {
+		ssize_t sent = send(connection.fd, connection.out.data() + connection.written,
+			connection.out.size() - connection.written, MSG_NOSIGNAL);
+		if(sent < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			if(errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			close(id);
+			return;
+		}
+		connection.written += sent;
+	}
+	if(connection.written == connection.out.size() ) {
+		connection.out.clear();
+		connection.written = 0;
+		if(connection.draining && connection.slots.empty() ) {
+			close(id);
+			return;
+		}
+	}
+	watch(id, connection);
+}
+
+bool Server::full(const Connection &connection) {
+	return connection.slots.size() >= maxOutstanding || connection.out.size() - connection.written >= maxUnsent;
+}
+
+// Waits for requests until the peer stops sending, unless the connection is
+// full, and for room to write while answers are left over. Answers delivered
+// and written call this again, which reads again once there is room
+void Server::watch(uint64_t id, Connection &connection) {
+	constexpr uint32_t none = 0, readable = EPOLLIN, writable = EPOLLOUT;
+	const uint32_t events = (connection.draining || full(connection) ? none : readable)
+		| (connection.out.empty() ? none : writable);
+	if(connection.watched && connection.events == events) {
+		return;
+	}
+	epoll_event event = {};
+	event.events = events;
+	event.data.u64 = id;
+	epoll_ctl(epollFd, connection.watched ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, connection.fd, &event);
+	connection.watched = true;
+	connection.events = events;
+}
+
+void Server::close(uint64_t id) {
+	auto found = connections.find(id);
+	::close(found->second.fd);
+	connections.erase(found);
+}
+
+void Server::dispatch() {
+	for(auto &[pattern, batch] : pending) {
+		Worker &worker = *workers[std::hash<std::string>()(pattern) % workers.size()];
+		batches++;
+		{
+			std::lock_guard lock(worker.mutex);
+			worker.batches.push_back(std::move(batch) );
+		}
+		worker.ready.notify_one();
+	}
+	pending.clear();
+}
+
+void Server::work(Worker &worker) {
+	std::vector<Answer> done;
+	for(;;) {
+		Batch batch;
+		{
+			std::unique_lock lock(worker.mutex);
+			worker.ready.wait(lock, [&] { return worker.stopping || !worker.batches.empty(); });
+			if(worker.batches.empty() ) {
+				return;
+			}
+			batch = std::move(worker.batches.front() );
+			worker.batches.pop_front();
+		}
+
+		Matcher *found = matcher(worker, batch.pattern);
+		for(Job &job : batch.jobs) {
+			done.push_back(Answer{job.connection, job.sequence,
+				found ? respond(*found, job.subject) : "! cannot parse pattern", job.arrived});
+		}
+		{
+			std::lock_guard lock(answersMutex);
+			answers.insert(answers.end(), std::make_move_iterator(done.begin() ), std::make_move_iterator(done.end() ) );
+		}
+		done.clear();
+		const uint64_t one = 1;
+		while(::write(answersFd, &one, sizeof(one) ) < 0 && errno == EINTR) {
+		}
+	}
+}
+
+// The matcher of pattern from the cache of the worker, or nullptr if it
+// cannot be parsed. Patterns that cannot be parsed are cached as well
+Matcher *Server::matcher(Worker &worker, const std::string &pattern) {
+	if(auto found = worker.cache.find(pattern); found != worker.cache.end() ) {
+		return found->second.get();
+	}
+	if(worker.cache.size() == cacheSize) {
+		worker.cache.clear();
+	}
+	Tokenizer tokenizer;
+	Parser parser;
+	Child root = parser.parseTokens(tokenizer.tokenize(pattern) );
+	auto &cached = worker.cache[pattern];
+	if(root) {
+		cached = std::make_unique<Matcher>(std::move(root), parser.groups() );
+	}
+	return cached.get();
+}
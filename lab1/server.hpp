@@ -0,0 +1,122 @@
+#pragma once
+#include "histogram.hpp"
+#include "matcher.hpp"
+
+#include <condition_variable>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Answers match requests on a Unix domain socket. A request is a line
+// holding a pattern and a subject separated by a tab, so neither can contain
+// a tab. Every request gets one line back, in the order the requests of the
+// connection came in:
+//
+//   0                   the subject does not match
+//   1 first-last ...    byte offsets of every selection in the subject
+//   ! why               the request could not be served
+//
+// One thread owns the sockets and waits on them with epoll. The requests read
+// in one round are batched per pattern, every batch goes to the worker the
+// pattern hashes to, so a pattern is parsed and planned once per worker and
+// its matcher is reused for every later request. Workers never touch the
+// sockets, their answers are handed back through an eventfd
+class Server {
+public:
+	// A longer line is refused by closing the connection
+	constexpr static size_t maxLine = 1 << 20;
+	// Matchers cached per worker, the cache is emptied when it fills up
+	constexpr static size_t cacheSize = 1024;
+	// A connection is not read from while it has this many requests
+	// unanswered or this many bytes of answers the peer has not taken, so a
+	// client that sends without reading cannot grow the server without bound
+	constexpr static size_t maxOutstanding = 1 << 14;
+	constexpr static size_t maxUnsent = 1 << 20;
+
+	explicit Server(unsigned workers);
+	Server(const Server &) = delete;
+	Server &operator=(const Server &) = delete;
+	~Server();
+
+	// Returns why the socket could not be opened, or nullptr. A socket left
+	// behind at path by an earlier server is replaced
+	const char *listen(const std::string &path);
+	// Serves until SIGINT or SIGTERM, then prints latencies and throughput
+	// to stderr
+	bool run();
+private:
+	struct Job {
+		uint64_t connection;
+		uint64_t sequence;
+		std::string subject;
+		Clock::time_point arrived;
+	};
+
+	struct Batch {
+		std::string pattern;
+		std::vector<Job> jobs;
+	};
+
+	struct Answer {
+		uint64_t connection;
+		uint64_t sequence;
+		std::string text;
+		Clock::time_point arrived;
+	};
+
+	struct Connection {
+		int fd;
+		std::string in, out;
+		size_t written = 0;
+		// Sequence of the next request and of the oldest one not yet
+		// written, answers wait in slots until those before them are done
+		uint64_t next = 0, first = 0;
+		std::deque<std::optional<std::string>> slots;
+		// The peer is done sending, closed once everything is answered
+		bool draining = false;
+		bool watched = false;
+		uint32_t events = 0;
+	};
+
+	struct Worker {
+		std::thread thread;
+		std::mutex mutex;
+		std::condition_variable ready;
+		std::deque<Batch> batches;
+		bool stopping = false;
+		std::unordered_map<std::string, std::unique_ptr<Matcher>> cache;
+	};
+
+	void accept();
+	void read(uint64_t id, Connection &connection);
+	void request(uint64_t id, Connection &connection, std::string_view line);
+	void answer(Connection &connection, uint64_t sequence, std::string text);
+	void deliver();
+	void flush(uint64_t id, Connection &connection);
+	void watch(uint64_t id, Connection &connection);
+	static bool full(const Connection &connection);
+	void close(uint64_t id);
+	void dispatch();
+
+	void work(Worker &worker);
+	Matcher *matcher(Worker &worker, const std::string &pattern);
+
+	std::string path;
+	int listenFd = -1, signalFd = -1, answersFd = -1, epollFd = -1;
+	std::unordered_map<uint64_t, Connection> connections;
+	uint64_t nextId;
+	std::unordered_map<std::string, Batch> pending;
+
+	std::vector<std::unique_ptr<Worker>> workers;
+	std::mutex answersMutex;
+	std::vector<Answer> answers;
+
+	LatencyHistogram latencies;
+	// Every request read, refused ones included, not only those batched
+	uint64_t requests = 0, batches = 0, accepted = 0;
+};
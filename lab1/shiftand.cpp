@@ -0,0 +1,86 @@
+#include "shiftand.hpp"
+
+bool ShiftAnd::compile(Node *root) {
+	masks.fill(0);
+	viewed = nullptr;
+	size = 0;
+	auto sequence = dynamic_cast<NodeSequence*>(root);
+	if(!sequence) {
+		return false;
+	}
+	for(auto &child : sequence->children) {
+		if(!compileNode(child.get(), false) ) {
+			size = 0;
+			return false;
+		}
+	}
+	return size > 0;
+}
+
+void ShiftAnd::view(const uint64_t *table, size_t length) {
+	viewed = table;
+	size = length;
+}
+
+bool ShiftAnd::search(Iterator first, Iterator last, Span &match) const {
+	const uint64_t *masks = table();
+	const uint64_t accept = uint64_t(1) << (size - 1);
+	uint64_t active = 0;
+	for(auto it = first; it != last; it++) {
+		active = ((active << 1) | 1) & masks[static_cast<unsigned char>(*it)];
+		if(active & accept) {
+			match = Span{std::next(it) - size, std::next(it)};
+			return true;
+		}
+	}
+	return false;
+}
+
+bool ShiftAnd::compileNode(Node *node, bool caseInsensitive) {
+	if(auto string = dynamic_cast<NodeString*>(node) ) {
+		if(size + string->value.size() > maxLength) {
+			return false;
+		}
+		for(char c : string->value) {
+			// Mirrors NodeString::eval(), under \I every byte with the same
+			// upper case form is accepted
+			const uint64_t bit = uint64_t(1) << size++;
+			for(int byte = 0; byte < 256; byte++) {
+				const char b = static_cast<char>(byte);
+				if(caseInsensitive ? std::toupper(b) == std::toupper(c) : b == c) {
+					masks[byte] |= bit;
+				}
+			}
+		}
+		return true;
+	}
+
+	if(dynamic_cast<NodeWildcard*>(node) ) {
+		if(size + 1 > maxLength) {
+			return false;
+		}
+		const uint64_t bit = uint64_t(1) << size++;
+		for(auto &mask : masks) {
+			mask |= bit;
+		}
+		return true;
+	}
+
+	if(dynamic_cast<NodeCaseInsensitive*>(node) ) {
+		return compileNode(node->children.front().get(), true);
+	}
+
+	if(auto counter = dynamic_cast<NodeCounter*>(node) ) {
+		if(counter->value < 1) {
+			return false;
+		}
+		for(int i = 0; i < counter->value; i++) {
+			if(!compileNode(node->children.front().get(), caseInsensitive) ) {
+				return false;
+			}
+		}
+		return true;
+	}
+
+	return false;
+}
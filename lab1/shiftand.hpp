@@ -0,0 +1,29 @@
+#pragma once
+#include "node.hpp"
+
+#include <array>
+#include <cstdint>
+
+// Bit-parallel (Shift-And) matcher for patterns that are a fixed sequence of
+// at most 64 character classes: strings, wildcards, \I and counters over
+// them. Each position of the pattern is a bit, a byte of the subject moves
+// every active position forward with one shift and one and
+class ShiftAnd {
+public:
+	constexpr static size_t maxLength = 64;
+
+	// Returns false, leaving the matcher unusable, if root is not eligible
+	bool compile(Node *root);
+	// Runs over masks owned by someone else, such as the tables of a mapped
+	// program file, table must hold 256 masks and outlive the matcher
+	void view(const uint64_t *table, size_t length);
+	bool search(Iterator first, Iterator last, Span &match) const;
+	size_t length() const { return size; }
+	const uint64_t *table() const { return viewed ? viewed : masks.data(); }
+private:
+	bool compileNode(Node *node, bool caseInsensitive);
+
+	std::array<uint64_t, 256> masks{};
+	const uint64_t *viewed = nullptr;
+	size_t size = 0;
+};
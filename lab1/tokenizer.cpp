@@ -40,6 +40,7 @@ std::ostream &operator<<(std::ostream &os, const Token &t) {
 Tokens Tokenizer::tokenize(const std::string &str) {
 	iterator = str.begin();
 	end = str.end();
+	tokens.clear();
 
 	while(!done() ) {
 		char lexeme = get();
@@ -102,24 +103,27 @@ Token Tokenizer::buildCounterToken() {
 	while(!done() && std::isdigit(peek() ) ) {
 		get();
 	}
-	if(peek() == '}') {
+	if(!done() && peek() == '}') {
 		token.type = TokenType::Counter;
 		token.value.assign(start, iterator);
+		get();
 	} else token.type = TokenType::Error;
-	get();
 	return token;
 }
 
 Token Tokenizer::buildEscapeToken() {
 	Token token, counter;
 	token.type = TokenType::Error;
+	if(done() ) {
+		return token;
+	}
 	char c = get();
 	switch(c) {
 		case 'I':
 			token.type = TokenType::CaseInsensitive;
 			break;
 		case 'O':
-			if(peek() != '{') break;
+			if(done() || peek() != '{') break;
 			get();
 			counter = buildCounterToken();
 			if(counter.type == TokenType::Counter) {
@@ -0,0 +1,379 @@
+#include "trigram.hpp"
+
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <numeric>
+
+namespace {
+
+Trigram makeTrigram(const char *bytes) {
+	return static_cast<unsigned char>(bytes[0]) << 16
+		| static_cast<unsigned char>(bytes[1]) << 8
+		| static_cast<unsigned char>(bytes[2]);
+}
+
+TrigramQuery all() {
+	return TrigramQuery{};
+}
+
+TrigramQuery single(Trigram trigram) {
+	return TrigramQuery{TrigramQuery::Op::Trigram, trigram, {}};
+}
+
+// Flattens nested operations of the same kind and folds in All, which an
+// And ignores and an Or is swallowed by
+TrigramQuery combine(TrigramQuery::Op op, std::vector<TrigramQuery> operands) {
+	TrigramQuery query{op, 0, {}};
+	for(auto &operand : operands) {
+		if(operand.op == TrigramQuery::Op::All) {
+			if(op == TrigramQuery::Op::Or) {
+				return all();
+			}
+		} else if(operand.op == op) {
+			for(auto &nested : operand.operands) {
+				query.operands.push_back(std::move(nested) );
+			}
+		} else {
+			query.operands.push_back(std::move(operand) );
+		}
+	}
+
+	// The same trigram turns up again in repeated and overlapping strings
+	auto same = [](const TrigramQuery &lhs, const TrigramQuery &rhs) {
+		return lhs.op == TrigramQuery::Op::Trigram && rhs.op == TrigramQuery::Op::Trigram
+			&& lhs.trigram == rhs.trigram;
+	};
+	for(auto it = query.operands.begin(); it != query.operands.end(); it++) {
+		auto end = std::remove_if(std::next(it), query.operands.end(),
+			[&](const TrigramQuery &other) { return same(*it, other); });
+		query.operands.erase(end, query.operands.end() );
+	}
+
+	if(query.operands.empty() ) {
+		return all();
+	}
+	if(query.operands.size() == 1) {
+		return std::move(query.operands.front() );
+	}
+	return query;
+}
+
+// Bytes a string byte matches under \I, the same comparison as
+// NodeString::eval() makes
+std::vector<char> caseVariants(char c) {
+	std::vector<char> variants;
+	for(int byte = 0; byte < 256; byte++) {
+		const char b = static_cast<char>(byte);
+		if(std::toupper(b) == std::toupper(c) ) {
+			variants.push_back(b);
+		}
+	}
+	return variants;
+}
+
+TrigramQuery planString(const std::string &value, bool caseInsensitive) {
+	std::vector<TrigramQuery> windows;
+	for(size_t i = 0; i + 3 <= value.size(); i++) {
+		if(!caseInsensitive) {
+			windows.push_back(single(makeTrigram(&value[i]) ) );
+			continue;
+		}
+		std::vector<TrigramQuery> variants;
+		for(char a : caseVariants(value[i]) ) {
+			for(char b : caseVariants(value[i + 1]) ) {
+				for(char c : caseVariants(value[i + 2]) ) {
+					const char bytes[] = {a, b, c};
+					variants.push_back(single(makeTrigram(bytes) ) );
+				}
+			}
+		}
+		windows.push_back(combine(TrigramQuery::Op::Or, std::move(variants) ) );
+	}
+	return combine(TrigramQuery::Op::And, std::move(windows) );
+}
+
+TrigramQuery plan(Node *node, bool caseInsensitive) {
+	if(auto string = dynamic_cast<NodeString*>(node) ) {
+		return planString(string->value, caseInsensitive);
+	}
+
+	if(dynamic_cast<NodeWildcard*>(node) ) {
+		return all();
+	}
+
+	if(dynamic_cast<NodeCaseInsensitive*>(node) ) {
+		return plan(node->children.front().get(), true);
+	}
+
+	if(auto counter = dynamic_cast<NodeCounter*>(node) ) {
+		// A counter of zero never evaluates its child
+		if(counter->value < 1) {
+			return all();
+		}
+		// A repeated string is a longer string, two copies past the first
+		// already hold every trigram of the repetition
+		if(auto string = dynamic_cast<NodeString*>(node->children.front().get() ) ) {
+			std::string repeated;
+			for(int i = 0; i < counter->value && i < 3; i++) {
+				repeated += string->value;
+			}
+			return planString(repeated, caseInsensitive);
+		}
+		return plan(node->children.front().get(), caseInsensitive);
+	}
+
+	std::vector<TrigramQuery> operands;
+	for(auto &child : node->children) {
+		operands.push_back(plan(child.get(), caseInsensitive) );
+	}
+	// Either needs one side to match, everything else needs all children,
+	// a repeated child matches at least once
+	return combine(dynamic_cast<NodeEither*>(node) ? TrigramQuery::Op::Or : TrigramQuery::Op::And,
+		std::move(operands) );
+}
+
+}
+
+std::ostream &operator<<(std::ostream &os, const TrigramQuery &query) {
+	switch(query.op) {
+		case TrigramQuery::Op::All:
+			return os << '*';
+		case TrigramQuery::Op::Trigram:
+			os << '"';
+			for(int shift = 16; shift >= 0; shift -= 8) {
+				const unsigned char c = query.trigram >> shift;
+				if(std::isprint(c) && c != '"' && c != '\\') {
+					os << c;
+				} else {
+					os << "\\x" << std::hex << std::setw(2) << std::setfill('0') << int(c) << std::dec;
+				}
+			}
+			return os << '"';
+		default:
+			break;
+	}
+	const char *separator = query.op == TrigramQuery::Op::And ? " & " : " | ";
+	os << '(';
+	for(size_t i = 0; i < query.operands.size(); i++) {
+		os << (i ? separator : "") << query.operands[i];
+	}
+	return os << ')';
+}
+
+TrigramQuery planTrigrams(Node *root) {
+	return plan(root, false);
+}
+
+void TrigramIndexWriter::index(std::string_view corpus) {
+	corpusSize = corpus.size();
+	lineRanges.clear();
+	postings.clear();
+
+	std::vector<Trigram> trigrams;
+	size_t first = 0;
+	while(first < corpus.size() ) {
+		size_t last = corpus.find('\n', first);
+		if(last == std::string_view::npos) {
+			last = corpus.size();
+		}
+		const uint32_t line = lineRanges.size();
+		lineRanges.push_back(TrigramLine{first, last});
+
+		trigrams.clear();
+		for(size_t i = first; i + 3 <= last; i++) {
+			trigrams.push_back(makeTrigram(corpus.data() + i) );
+		}
+		std::sort(trigrams.begin(), trigrams.end() );
+		trigrams.erase(std::unique(trigrams.begin(), trigrams.end() ), trigrams.end() );
+		// Lines are visited in order, every posting list stays sorted
+		for(Trigram trigram : trigrams) {
+			postings[trigram].push_back(line);
+		}
+		first = last + 1;
+	}
+}
+
+bool TrigramIndexWriter::write(const std::string &path) const {
+	std::vector<TrigramEntry> entries;
+	entries.reserve(postings.size() );
+	uint64_t postingCount = 0;
+	for(auto &[trigram, lines] : postings) {
+		entries.push_back(TrigramEntry{trigram, static_cast<uint32_t>(lines.size() ), 0});
+		postingCount += lines.size();
+	}
+	std::sort(entries.begin(), entries.end(), [](const TrigramEntry &lhs, const TrigramEntry &rhs) {
+		return lhs.trigram < rhs.trigram;
+	});
+
+	TrigramHeader header{};
+	std::copy(std::begin(TrigramFormat::magic), std::end(TrigramFormat::magic), header.magic);
+	header.version = TrigramFormat::version;
+	header.byteOrder = TrigramFormat::byteOrder;
+	header.corpusSize = corpusSize;
+	header.lineCount = lineRanges.size();
+	header.trigramCount = entries.size();
+	header.postingCount = postingCount;
+	header.lines = align(sizeof(TrigramHeader) );
+	header.trigrams = align(header.lines + lineRanges.size() * sizeof(TrigramLine) );
+	header.postings = align(header.trigrams + entries.size() * sizeof(TrigramEntry) );
+	header.size = header.postings + postingCount * sizeof(uint32_t);
+
+	std::string image(header.size, '\0');
+	if(!lineRanges.empty() ) {
+		std::memcpy(&image[header.lines], lineRanges.data(), lineRanges.size() * sizeof(TrigramLine) );
+	}
+	uint64_t offset = 0;
+	for(auto &entry : entries) {
+		auto &lines = postings.at(entry.trigram);
+		entry.first = offset;
+		std::memcpy(&image[header.postings + offset * sizeof(uint32_t)], lines.data(),
+			lines.size() * sizeof(uint32_t) );
+		offset += lines.size();
+	}
+	if(!entries.empty() ) {
+		std::memcpy(&image[header.trigrams], entries.data(), entries.size() * sizeof(TrigramEntry) );
+	}
+	header.checksum = checksum(image.data() + sizeof(TrigramHeader), image.data() + image.size() );
+	std::memcpy(&image[0], &header, sizeof(TrigramHeader) );
+
+	std::ofstream file(path, std::ios::binary | std::ios::trunc);
+	file.write(image.data(), image.size() );
+	return static_cast<bool>(file);
+}
+
+bool TrigramIndex::map(const std::string &path) {
+	if(const char *why = file.map(path) ) {
+		return fail(why);
+	}
+	if(file.size() < sizeof(TrigramHeader) ) {
+		return fail("file too small");
+	}
+	base = file.data();
+	length = file.size();
+	header = reinterpret_cast<const TrigramHeader*>(base);
+	return validate();
+}
+
+void TrigramIndex::printErr() const {
+	std::cerr << "Bad index file: " << (error ? error : "not mapped") << '\n';
+}
+
+bool TrigramIndex::fail(const char *why) {
+	error = why;
+	header = nullptr;
+	return false;
+}
+
+bool TrigramIndex::validate() {
+	if(!std::equal(std::begin(TrigramFormat::magic), std::end(TrigramFormat::magic), header->magic) ) {
+		return fail("not an index file");
+	}
+	if(header->byteOrder != TrigramFormat::byteOrder) {
+		return fail("wrong byte order");
+	}
+	if(header->version != TrigramFormat::version) {
+		return fail("unsupported version");
+	}
+	if(header->size != length) {
+		return fail("truncated");
+	}
+	if(header->checksum != checksum(base + sizeof(TrigramHeader), base + length) ) {
+		return fail("checksum mismatch");
+	}
+	if(!fits(header->lines, header->lineCount, sizeof(TrigramLine), length)
+		|| !fits(header->trigrams, header->trigramCount, sizeof(TrigramEntry), length)
+		|| !fits(header->postings, header->postingCount, sizeof(uint32_t), length) ) {
+		return fail("section out of bounds");
+	}
+
+	lineRanges = reinterpret_cast<const TrigramLine*>(base + header->lines);
+	entries = reinterpret_cast<const TrigramEntry*>(base + header->trigrams);
+	postings = reinterpret_cast<const uint32_t*>(base + header->postings);
+
+	for(uint32_t i = 0; i < header->lineCount; i++) {
+		if(lineRanges[i].first > lineRanges[i].last || lineRanges[i].last > header->corpusSize) {
+			return fail("malformed line");
+		}
+	}
+	for(uint32_t i = 0; i < header->trigramCount; i++) {
+		const TrigramEntry &entry = entries[i];
+		if((i > 0 && entries[i - 1].trigram >= entry.trigram)
+			|| entry.first > header->postingCount
+			|| entry.count > header->postingCount - entry.first) {
+			return fail("malformed trigram");
+		}
+		for(uint64_t p = entry.first; p < entry.first + entry.count; p++) {
+			if(postings[p] >= header->lineCount || (p > entry.first && postings[p - 1] >= postings[p]) ) {
+				return fail("malformed posting list");
+			}
+		}
+	}
+	return true;
+}
+
+std::vector<uint32_t> TrigramIndex::candidates(const TrigramQuery &query) const {
+	std::vector<uint32_t> lines;
+	if(!collect(query, lines) ) {
+		lines.resize(this->lines() );
+		std::iota(lines.begin(), lines.end(), 0);
+	}
+	return lines;
+}
+
+bool TrigramIndex::collect(const TrigramQuery &query, std::vector<uint32_t> &out) const {
+	switch(query.op) {
+		case TrigramQuery::Op::All:
+			return false;
+
+		case TrigramQuery::Op::Trigram: {
+			auto last = entries + header->trigramCount;
+			auto it = std::lower_bound(entries, last, query.trigram,
+				[](const TrigramEntry &entry, Trigram trigram) { return entry.trigram < trigram; });
+			out.clear();
+			if(it != last && it->trigram == query.trigram) {
+				out.assign(postings + it->first, postings + it->first + it->count);
+			}
+			return true;
+		}
+
+		case TrigramQuery::Op::And: {
+			bool any = false;
+			std::vector<uint32_t> operand, both;
+			for(auto &q : query.operands) {
+				if(!collect(q, operand) ) {
+					continue;
+				}
+				if(!any) {
+					out.swap(operand);
+					any = true;
+				} else {
+					both.clear();
+					std::set_intersection(out.begin(), out.end(), operand.begin(), operand.end(),
+						std::back_inserter(both) );
+					out.swap(both);
+				}
+				if(out.empty() ) {
+					break;
+				}
+			}
+			return any;
+		}
+
+		case TrigramQuery::Op::Or: {
+			std::vector<uint32_t> operand, either;
+			out.clear();
+			for(auto &q : query.operands) {
+				if(!collect(q, operand) ) {
+					return false;
+				}
+				either.clear();
+				std::set_union(out.begin(), out.end(), operand.begin(), operand.end(),
+					std::back_inserter(either) );
+				out.swap(either);
+			}
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,119 @@
+#pragma once
+#include "mapped.hpp"
+#include "node.hpp"
+
+#include <cstdint>
+#include <string_view>
+#include <unordered_map>
+
+// Trigram index over the lines of a corpus. For every sequence of three
+// bytes that occurs in the corpus the index holds the ascending list of lines
+// it occurs in. A pattern is turned into a boolean query over trigrams that
+// every line it can match satisfies, so only the lines the query selects
+// have to be handed to a matcher
+//
+// Layout, every section starts on an 8 byte boundary:
+//   TrigramHeader
+//   TrigramLine[lineCount]        byte range of every line in the corpus
+//   TrigramEntry[trigramCount]    ascending by trigram
+//   uint32_t[postingCount]        line numbers, a run per trigram
+
+using Trigram = uint32_t;
+
+namespace TrigramFormat {
+	constexpr char magic[8] = {'L', '1', 'T', 'R', 'G', 'M', '\0', '\0'};
+	constexpr uint32_t version = 1;
+	constexpr uint32_t byteOrder = 0x01020304;
+};
+
+struct TrigramHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t byteOrder;
+	// Size of the whole file and FNV-1a over everything after the header
+	uint64_t size;
+	uint64_t checksum;
+	// Size of the indexed corpus, an index is stale once the size changes
+	uint64_t corpusSize;
+	uint32_t lineCount;
+	uint32_t trigramCount;
+	uint64_t postingCount;
+	uint64_t lines;
+	uint64_t trigrams;
+	uint64_t postings;
+};
+
+struct TrigramLine {
+	uint64_t first;
+	uint64_t last;
+};
+
+struct TrigramEntry {
+	Trigram trigram;
+	uint32_t count;
+	uint64_t first;
+};
+
+// Lines that satisfy the query are the only ones a pattern can match. All
+// selects every line, it is what is left of parts of a pattern that do not
+// require any trigram, such as wildcards and strings shorter than three
+struct TrigramQuery {
+	enum struct Op {
+		All,
+		And,
+		Or,
+		Trigram
+	};
+
+	Op op = Op::All;
+	Trigram trigram = 0;
+	std::vector<TrigramQuery> operands;
+};
+
+std::ostream &operator<<(std::ostream &os, const TrigramQuery &query);
+
+// Derives the query from a parsed pattern. Every string a match must contain
+// contributes its trigrams, a sequence requires all of its children and an
+// either one of its sides. Under \I every trigram may be any of its case
+// variants
+TrigramQuery planTrigrams(Node *root);
+
+class TrigramIndexWriter {
+public:
+	// Indexes every line of corpus, a line ends before a '\n'
+	void index(std::string_view corpus);
+	bool write(const std::string &path) const;
+	size_t lines() const { return lineRanges.size(); }
+	size_t trigrams() const { return postings.size(); }
+private:
+	uint64_t corpusSize = 0;
+	std::vector<TrigramLine> lineRanges;
+	std::unordered_map<Trigram, std::vector<uint32_t>> postings;
+};
+
+// A trigram index mapped read-only
+class TrigramIndex {
+public:
+	bool map(const std::string &path);
+	void printErr() const;
+
+	size_t lines() const { return header ? header->lineCount : 0; }
+	uint64_t corpusSize() const { return header ? header->corpusSize : 0; }
+	const TrigramLine &line(uint32_t index) const { return lineRanges[index]; }
+	// Lines that satisfy query, in ascending order
+	std::vector<uint32_t> candidates(const TrigramQuery &query) const;
+private:
+	bool fail(const char *why);
+	bool validate();
+	// Returns false, with out left unspecified, when query selects every line
+	bool collect(const TrigramQuery &query, std::vector<uint32_t> &out) const;
+
+	MappedFile file;
+	const char *base = nullptr;
+	size_t length = 0;
+	const TrigramHeader *header = nullptr;
+	const TrigramLine *lineRanges = nullptr;
+	const TrigramEntry *entries = nullptr;
+	const uint32_t *postings = nullptr;
+	const char *error = nullptr;
+};
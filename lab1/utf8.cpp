@@ -0,0 +1,153 @@
+#include "utf8.hpp"
+
+#include <cstdint>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace {
+
+// Bytes before the next one with its high bit set, a multiple of 16
+size_t asciiPrefix(const char *first, const char *last) {
+	size_t skipped = 0;
+#ifdef __SSE2__
+	while(last - first >= 16) {
+		const __m128i chunk = _mm_loadu_si128(reinterpret_cast<const __m128i*>(first) );
+		if(_mm_movemask_epi8(chunk) != 0) {
+			break;
+		}
+		first += 16;
+		skipped += 16;
+	}
+#endif
+	return skipped;
+}
+
+bool inRange(const char *it, unsigned char low, unsigned char high) {
+	const unsigned char c = static_cast<unsigned char>(*it);
+	return c >= low && c <= high;
+}
+
+}
+
+bool isAscii(const char *first, const char *last) {
+	first += asciiPrefix(first, last);
+	for(; first != last; first++) {
+		if(static_cast<unsigned char>(*first) >= 0x80) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool isValidUtf8(const char *first, const char *last) {
+	while(first != last) {
+		first += asciiPrefix(first, last);
+		if(first == last) {
+			break;
+		}
+		const unsigned char lead = static_cast<unsigned char>(*first);
+		const size_t length = utf8Length(*first);
+		if(length == 0 || static_cast<size_t>(last - first) < length) {
+			return false;
+		}
+		if(length == 1) {
+			first++;
+			continue;
+		}
+
+		// The second byte is where overlong forms, surrogates and code points
+		// past U+10FFFF show, the rest only have to be continuation bytes
+		unsigned char low = 0x80, high = 0xBF;
+		if(lead == 0xE0) {
+			low = 0xA0;
+		} else if(lead == 0xED) {
+			high = 0x9F;
+		} else if(lead == 0xF0) {
+			low = 0x90;
+		} else if(lead == 0xF4) {
+			high = 0x8F;
+		}
+		if(!inRange(first + 1, low, high) ) {
+			return false;
+		}
+		for(size_t i = 2; i < length; i++) {
+			if(!isUtf8Continuation(first[i]) ) {
+				return false;
+			}
+		}
+		first += length;
+	}
+	return true;
+}
+
+char32_t foldCase(char32_t c) {
+	// Blocks where upper and lower case alternate, upper case first
+	auto alternating = [c](char32_t first, char32_t last) {
+		return c >= first && c <= last && (c - first) % 2 == 0;
+	};
+
+	if(c < 0x80) {
+		return c >= 'A' && c <= 'Z' ? c + 0x20 : c;
+	}
+	if(c == 0xB5) {
+		return 0x3BC;
+	}
+	if(c >= 0xC0 && c <= 0xDE && c != 0xD7) {
+		return c + 0x20;
+	}
+	if(alternating(0x100, 0x12E) || alternating(0x132, 0x136) || alternating(0x139, 0x147)
+		|| alternating(0x14A, 0x176) || alternating(0x179, 0x17D) ) {
+		return c + 1;
+	}
+	if(c == 0x178) {
+		return 0xFF;
+	}
+	if(c == 0x17F) {
+		return 's';
+	}
+	if(c == 0x386) {
+		return 0x3AC;
+	}
+	if(c >= 0x388 && c <= 0x38A) {
+		return c + 37;
+	}
+	if(c == 0x38C) {
+		return 0x3CC;
+	}
+	if(c == 0x38E || c == 0x38F) {
+		return c + 63;
+	}
+	if( (c >= 0x391 && c <= 0x3A1) || (c >= 0x3A3 && c <= 0x3AB) ) {
+		return c + 0x20;
+	}
+	if(c == 0x3C2) {
+		return 0x3C3;
+	}
+	if(c >= 0x400 && c <= 0x40F) {
+		return c + 0x50;
+	}
+	if(c >= 0x410 && c <= 0x42F) {
+		return c + 0x20;
+	}
+	if(alternating(0x460, 0x480) || alternating(0x48A, 0x4BE) ) {
+		return c + 1;
+	}
+	if(c >= 0x531 && c <= 0x556) {
+		return c + 0x30;
+	}
+	if(alternating(0x1E00, 0x1E94) || alternating(0x1EA0, 0x1EFE) ) {
+		return c + 1;
+	}
+	if(c == 0x212A) {
+		return 'k';
+	}
+	if(c == 0x212B) {
+		return 0xE5;
+	}
+	if(c >= 0xFF21 && c <= 0xFF3A) {
+		return c + 0x20;
+	}
+	return c;
+}
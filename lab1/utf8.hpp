@@ -0,0 +1,58 @@
+#pragma once
+#include <cstddef>
+
+// UTF-8 as RFC 3629 has it: no overlong forms, no surrogates and nothing
+// past U+10FFFF
+
+// Whether [first, last) is all ASCII, 16 bytes at a time where SSE2 is there
+bool isAscii(const char *first, const char *last);
+
+// Validates [first, last) in one pass. Runs of ASCII are skipped 16 bytes at
+// a time, only the multibyte sequences are decoded
+bool isValidUtf8(const char *first, const char *last);
+
+inline bool isUtf8Continuation(char c) {
+	return (static_cast<unsigned char>(c) & 0xC0) == 0x80;
+}
+
+// Length of the sequence lead starts, zero if lead cannot start one
+inline size_t utf8Length(char lead) {
+	const unsigned char c = static_cast<unsigned char>(lead);
+	if(c < 0x80) {
+		return 1;
+	} else if(c < 0xC2) {
+		return 0;
+	} else if(c < 0xE0) {
+		return 2;
+	} else if(c < 0xF0) {
+		return 3;
+	} else if(c < 0xF5) {
+		return 4;
+	}
+	return 0;
+}
+
+// Decodes the code point at it and moves it past it. Input is expected to
+// be valid, but a sequence that is cut off by last or starts with a
+// continuation byte is refused, leaving it where it was
+template<typename Iterator>
+bool decodeUtf8(Iterator &it, Iterator last, char32_t &codePoint) {
+	if(it == last) {
+		return false;
+	}
+	const size_t length = utf8Length(*it);
+	if(length == 0 || static_cast<size_t>(last - it) < length) {
+		return false;
+	}
+	constexpr unsigned char leadBits[] = {0, 0x7F, 0x1F, 0x0F, 0x07};
+	codePoint = static_cast<unsigned char>(*it++) & leadBits[length];
+	for(size_t i = 1; i < length; i++) {
+		codePoint = codePoint << 6 | (static_cast<unsigned char>(*it++) & 0x3F);
+	}
+	return true;
+}
+
+// Simple case folding, one code point to one code point. Covers ASCII,
+// Latin-1, Latin Extended-A and Additional, Greek, Cyrillic, Armenian and
+// the fullwidth ASCII forms, everything else folds to itself
+char32_t foldCase(char32_t codePoint);
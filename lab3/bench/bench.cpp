@@ -0,0 +1,83 @@
+#include <chrono>
+#include <cmath>
+#include <iomanip>
+#include <iostream>
+#include <random>
+#include <string_view>
+#include <vector>
+
+#include "pow.hpp"
+
+using Clock = std::chrono::steady_clock;
+
+constexpr size_t count = 1 << 14;
+constexpr size_t rounds = 2000;
+
+template<typename T>
+void doNotOptimize(const T &value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+template<typename Fn>
+double measure(std::vector<double> &out, Fn fn) {
+	fn();
+	auto start = Clock::now();
+	for(size_t i = 0; i < rounds; i++) {
+		fn();
+		doNotOptimize(out.data() );
+	}
+	auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+	return elapsed / (count * rounds);
+}
+
+void print(std::string_view name, double ns, double baseline) {
+	std::cout << "  " << std::left << std::setw(22) << name << std::right
+		<< std::setw(8) << std::fixed << std::setprecision(3) << ns << " ns/element"
+		<< std::setw(8) << std::setprecision(1) << baseline / ns << "x\n";
+}
+
+template<int exp>
+void compare(const std::vector<double> &bases, std::vector<double> &out) {
+	std::cout << "exponent " << exp << '\n';
+
+	double baseline = measure(out, [&]() {
+		for(size_t i = 0; i < count; i++) {
+			out[i] = std::pow(bases[i], exp);
+		}
+	});
+	print("std::pow", baseline, baseline);
+
+	int64_t runtimeExp = exp;
+	doNotOptimize(runtimeExp);
+	print("power(base, exp)", measure(out, [&]() {
+		for(size_t i = 0; i < count; i++) {
+			out[i] = power(bases[i], runtimeExp);
+		}
+	}), baseline);
+	print("power<exp>(base)", measure(out, [&]() {
+		for(size_t i = 0; i < count; i++) {
+			out[i] = power<exp>(bases[i]);
+		}
+	}), baseline);
+	print("powerBatch(..., exp)", measure(out, [&]() {
+		powerBatch(bases.data(), out.data(), count, runtimeExp);
+	}), baseline);
+	print("powerBatch<exp>", measure(out, [&]() {
+		powerBatch<exp>(bases.data(), out.data(), count);
+	}), baseline);
+}
+
+int main() {
+	std::mt19937 rng(1);
+	std::uniform_real_distribution<double> dist(0.5, 1.5);
+	std::vector<double> bases(count), out(count);
+	for(auto &b : bases) {
+		b = dist(rng);
+	}
+
+	compare<2>(bases, out);
+	compare<7>(bases, out);
+	compare<13>(bases, out);
+	compare<64>(bases, out);
+	compare<-5>(bases, out);
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <type_traits>
+
+// Compile time value, by squaring so that only log2(exp) templates are
+// instantiated instead of one per unit of the exponent
+template<typename T, T val, unsigned exp>
+struct Pow {
+	constexpr static T half = Pow<T, val, exp / 2>::value;
+	constexpr static T value = exp % 2 ? half * half * val : half * half;
+};
+
+template<typename T, T val>
+struct Pow<T, val, 1> {
+	constexpr static T value = val;
+};
+
+template<typename T, T val>
+struct Pow<T, val, 0> {
+	constexpr static T value = 1;
+};
+
+// Runtime base, compile time exponent. The squaring chain is unrolled during
+// instantiation, power<13>(n) becomes five multiplications with no branches.
+// Mul lets callers substitute e.g. an overflow checked multiplication
+template<int exp, typename T, typename Mul = std::multiplies<T>>
+constexpr std::enable_if_t<(exp >= 0), T> power(T base, Mul mul = Mul() ) {
+	if constexpr(exp == 0) {
+		return T(1);
+	} else if constexpr(exp == 1) {
+		return base;
+	} else {
+		T half = power<exp / 2>(base, mul);
+		T square = mul(half, half);
+		if constexpr(exp % 2) {
+			return mul(square, base);
+		} else {
+			return square;
+		}
+	}
+}
+
+// Negative exponents only make sense for floating types
+template<int exp, typename T, typename Mul = std::multiplies<T>>
+constexpr std::enable_if_t<(exp < 0) && std::is_floating_point_v<T>, T> power(T base, Mul mul = Mul() ) {
+	return T(1) / power<-exp>(base, mul);
+}
+
+// Runtime base and exponent, square-and-multiply
+template<typename T, typename Mul = std::multiplies<T>>
+constexpr T power(T base, int64_t exp, Mul mul = Mul() ) {
+	if(exp < 0) {
+		if constexpr(std::is_floating_point_v<T>) {
+			return T(1) / power(base, -(exp + 1), mul) / base;
+		} else {
+			throw std::domain_error("negative exponent");
+		}
+	}
+	T result(1);
+	while(exp) {
+		if(exp & 1) {
+			result = mul(result, base);
+		}
+		exp >>= 1;
+		if(exp) {
+			base = mul(base, base);
+		}
+	}
+	return result;
+}
+
+// Batched variants. Every lane runs the same multiplication chain, so the
+// loops carry no per-element branches and are vectorised by the compiler
+
+template<int exp, typename T>
+void powerBatch(const T *__restrict bases, T *__restrict out, size_t count) {
+	for(size_t i = 0; i < count; i++) {
+		out[i] = power<exp>(bases[i]);
+	}
+}
+
+// The exponent is shared by the batch, so the bit loop is hoisted outside and
+// the inner loops over a block of lanes are straight multiplications
+template<typename T>
+void powerBatch(const T *__restrict bases, T *__restrict out, size_t count, int64_t exp) {
+	constexpr size_t block = 256;
+	const bool invert = exp < 0;
+	if constexpr(!std::is_floating_point_v<T>) {
+		if(invert) {
+			throw std::domain_error("negative exponent");
+		}
+	}
+	uint64_t magnitude = invert ? 0 - static_cast<uint64_t>(exp) : static_cast<uint64_t>(exp);
+
+	T squares[block];
+	for(size_t first = 0; first < count; first += block) {
+		const size_t lanes = count - first < block ? count - first : block;
+		T *__restrict result = out + first;
+		for(size_t i = 0; i < lanes; i++) {
+			squares[i] = bases[first + i];
+			result[i] = T(1);
+		}
+		for(uint64_t bits = magnitude; bits; bits >>= 1) {
+			if(bits & 1) {
+				for(size_t i = 0; i < lanes; i++) {
+					result[i] *= squares[i];
+				}
+			}
+			if(bits > 1) {
+				for(size_t i = 0; i < lanes; i++) {
+					squares[i] *= squares[i];
+				}
+			}
+		}
+		if constexpr(std::is_floating_point_v<T>) {
+			if(invert) {
+				for(size_t i = 0; i < lanes; i++) {
+					result[i] = T(1) / result[i];
+				}
+			}
+		}
+	}
+}
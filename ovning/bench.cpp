@@ -0,0 +1,460 @@
+#include "calc.hpp"
+#include "stream.hpp"
+
+#include <chrono>
+#include <cstdlib>
+#include <iomanip>
+#include <new>
+#include <random>
+#include <sstream>
+
+#include <sys/resource.h>
+
+// Every allocation is prefixed with its size so that the live heap, and its
+// high-water mark, can be tracked per strategy
+
+namespace Heap {
+	size_t live = 0;
+	size_t peak = 0;
+
+	void resetPeak() {
+		peak = live;
+	}
+};
+
+void *operator new(size_t size) {
+	auto block = static_cast<size_t*>(std::malloc(size + sizeof(max_align_t) ) );
+	if(!block) throw std::bad_alloc();
+	*block = size;
+	Heap::live += size;
+	Heap::peak = std::max(Heap::peak, Heap::live);
+	return reinterpret_cast<char*>(block) + sizeof(max_align_t);
+}
+
+void operator delete(void *ptr) noexcept {
+	if(!ptr) return;
+	auto block = reinterpret_cast<size_t*>(static_cast<char*>(ptr) - sizeof(max_align_t) );
+	Heap::live -= *block;
+	std::free(block);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+	operator delete(ptr);
+}
+
+enum struct Shape {
+	Random,
+	Flat,
+	Chain
+};
+
+constexpr static std::array<std::string_view, 3> shapeStrings = {
+	"random",
+	"flat",
+	"chain"
+};
+
+struct Options {
+	std::vector<Shape> shapes = { Shape::Random, Shape::Flat, Shape::Chain };
+	std::vector<size_t> lengths = { 1000, 4000, 16000 };
+	std::string mix = "+-*/^";
+	size_t tokenBudget = 1 << 20;
+	size_t diff = 0;
+	unsigned seed = 1;
+};
+
+// Operands stay small and non-zero so that the float policy neither saturates
+// nor divides by zero, which keeps the generated input representative.
+// Exponents are at most 4 and never chained.
+//
+// random: operators drawn from the mix, operands are sometimes negated
+// flat:   only low precedence operators, the split is found immediately
+// chain:  a single low precedence operator followed by a right-heavy chain of
+//         high precedence operators, every level of the recursive split has
+//         to scan the full remaining range before finding its operator
+std::string generate(Shape shape, size_t operands, const std::string &mix, std::mt19937 &rng) {
+	std::string lowOps, highOps;
+	for(char c : mix) {
+		(c == '+' || c == '-' ? lowOps : highOps).push_back(c);
+	}
+	if(lowOps.empty() ) lowOps = "+";
+	if(highOps.empty() ) highOps = "*";
+
+	auto pick = [&rng](const std::string &from) {
+		return from[std::uniform_int_distribution<size_t>(0, from.size() - 1)(rng)];
+	};
+
+	std::string expr;
+	expr.reserve(operands * 4);
+	char op = 0;
+	for(size_t i = 0; i < operands; i++) {
+		if(i > 0) {
+			const char prev = op;
+			switch(shape) {
+				case Shape::Random:
+					op = pick(mix);
+					break;
+				case Shape::Flat:
+					op = pick(lowOps);
+					break;
+				case Shape::Chain:
+					op = i == 1 ? pick(lowOps) : pick(highOps);
+					break;
+			}
+			// Towers of ^ grow beyond what the arbitrary precision policy
+			// can compute in reasonable time
+			if(op == '^' && prev == '^') {
+				op = '*';
+			}
+			expr += ' ';
+			expr += op;
+			expr += ' ';
+		}
+		if(shape == Shape::Random && rng() % 8 == 0) {
+			expr += '-';
+		}
+		const int maxDigit = op == '^' ? 3 : 8;
+		expr += static_cast<char>('1' + std::uniform_int_distribution<int>(0, maxDigit)(rng) );
+	}
+	return expr;
+}
+
+using Clock = std::chrono::steady_clock;
+
+// The recursive evaluator recurses once per operator on the chain shape
+constexpr static size_t recursiveLimit = 1 << 16;
+
+struct Sample {
+	double nsPerToken;
+	size_t peakHeap;
+};
+
+// Runs fn over every input until roughly tokenBudget tokens have been
+// processed and reports the per-token cost and the extra heap it needed
+template<typename Fn>
+Sample measure(size_t tokensPerRun, size_t tokenBudget, Fn fn) {
+	size_t runs = std::max<size_t>(1, tokenBudget / std::max<size_t>(1, tokensPerRun) );
+	fn();
+
+	Heap::resetPeak();
+	const size_t base = Heap::live;
+	auto start = Clock::now();
+	for(size_t i = 0; i < runs; i++) {
+		fn();
+	}
+	auto elapsed = std::chrono::duration<double, std::nano>(Clock::now() - start).count();
+	return { elapsed / static_cast<double>(runs * tokensPerRun), Heap::peak - base };
+}
+
+template<typename T>
+void doNotOptimize(const T &value) {
+	asm volatile("" : : "r,m"(value) : "memory");
+}
+
+void printSample(std::string_view name, const Sample &sample) {
+	std::cout << "  " << std::left << std::setw(12) << name << std::right
+		<< std::setw(10) << std::fixed << std::setprecision(2) << sample.nsPerToken << " ns/token"
+		<< std::setw(12) << sample.peakHeap / 1024.0 << " KiB peak heap\n";
+}
+
+void benchmark(const Options &options) {
+	std::mt19937 rng(options.seed);
+	Evaluator<Float> evaluator;
+	StreamReducer<Float> reducer;
+	for(auto shape : options.shapes) {
+		for(auto length : options.lengths) {
+			std::string expr = generate(shape, length, options.mix, rng);
+			Tokens tokens = tokenize(expr);
+			if(tokens.empty() ) {
+				std::cerr << "Generated expression did not tokenize\n";
+				continue;
+			}
+
+			std::cout << shapeStrings[static_cast<size_t>(shape)] << ", "
+				<< tokens.size() << " tokens\n";
+
+			// The chain shape is quadratic in the recursive split, scale the
+			// budget so that each configuration stays within a few seconds
+			size_t budget = shape == Shape::Chain
+				? std::max<size_t>(tokens.size(), options.tokenBudget / (tokens.size() / 64 + 1) )
+				: options.tokenBudget;
+
+			printSample("tokenize", measure(tokens.size(), budget, [&]() {
+				Tokens t = tokenize(expr);
+				doNotOptimize(t.data() );
+			}) );
+			if(tokens.size() <= recursiveLimit) {
+				printSample("eval", measure(tokens.size(), budget, [&]() {
+					doNotOptimize(eval<Float>(tokens.begin(), tokens.end() ) );
+				}) );
+			} else {
+				std::cout << "  eval        skipped, would exhaust the call stack\n";
+			}
+			printSample("stack eval", measure(tokens.size(), budget, [&]() {
+				doNotOptimize(evaluator.eval(tokens.begin(), tokens.end() ) );
+			}) );
+			printSample("buildTree", measure(tokens.size(), budget, [&]() {
+				doNotOptimize(evaluator.evalTree(tokens) );
+			}) );
+			// Tokenizes as well, from the characters rather than the tokens
+			printSample("stream", measure(tokens.size(), budget, [&]() {
+				StreamTokenizer tokenizer;
+				auto push = [&](const Token &token) {
+					reducer.push(token);
+				};
+				tokenizer.feed(expr.data(), expr.size(), push);
+				tokenizer.finish(push);
+				doNotOptimize(reducer.finish() );
+			}) );
+		}
+	}
+
+	rusage usage;
+	getrusage(RUSAGE_SELF, &usage);
+	std::cout << "peak resident set: " << usage.ru_maxrss << " KiB\n";
+}
+
+// Compares the compile time multiplication chains dispatched to for literal
+// exponents against the generic square-and-multiply that ^ otherwise uses
+template<typename Policy>
+void benchmarkPower(std::string_view name, const std::vector<typename Policy::Value> &bases) {
+	using Value = typename Policy::Value;
+	constexpr size_t rounds = 200;
+	const size_t count = bases.size();
+
+	std::cout << "power, " << name << '\n';
+	for(int64_t exp : { 2, 5, 9, 16 }) {
+		Value sink = Value(0);
+		auto time = [&](auto fn) {
+			auto start = Clock::now();
+			for(size_t r = 0; r < rounds; r++) {
+				for(size_t i = 0; i < count; i++) {
+					sink = sink + fn(bases[i]);
+				}
+			}
+			doNotOptimize(sink);
+			return std::chrono::duration<double, std::nano>(Clock::now() - start).count()
+				/ static_cast<double>(rounds * count);
+		};
+
+		int64_t runtimeExp = exp;
+		doNotOptimize(runtimeExp);
+		double generic = time([&](const Value &base) {
+			return Policy::calc(base, Value(runtimeExp), '^');
+		});
+		double specialized = time([&](const Value &base) {
+			return raise<Policy>(base, runtimeExp);
+		});
+		std::cout << "  exponent " << std::setw(2) << exp << std::fixed << std::setprecision(2)
+			<< std::setw(10) << generic << " ns generic"
+			<< std::setw(10) << specialized << " ns specialized"
+			<< std::setw(8) << generic / specialized << "x\n";
+	}
+}
+
+void benchmarkPower(unsigned seed) {
+	std::mt19937 rng(seed);
+	std::vector<int64_t> integers(4096);
+	std::vector<float> floats(integers.size() );
+	for(size_t i = 0; i < integers.size(); i++) {
+		integers[i] = std::uniform_int_distribution<int64_t>(-12, 12)(rng);
+		floats[i] = std::uniform_real_distribution<float>(0.5f, 1.5f)(rng);
+	}
+	benchmarkPower<Int64>("int64", integers);
+	benchmarkPower<Float>("float", floats);
+}
+
+template<typename Fn>
+std::string outcome(Fn fn) {
+	std::ostringstream os;
+	os << std::setprecision(std::numeric_limits<float>::max_digits10);
+	try {
+		os << fn();
+	} catch(const std::exception &e) {
+		os << "ERROR (" << e.what() << ')';
+	}
+	return os.str();
+}
+
+// What eval, stack eval, buildTree and stream make of expr, in that order
+template<typename Policy>
+std::array<std::string, 4> strategies(const std::string &expr, Evaluator<Policy> &evaluator,
+		StreamReducer<Policy> &reducer, std::mt19937 &rng) {
+	Tokens tokens = tokenize(expr);
+	auto byRange = outcome([&]() {
+		return eval<Policy>(tokens.begin(), tokens.end() );
+	});
+	auto byStack = outcome([&]() {
+		return evaluator.eval(tokens.begin(), tokens.end() );
+	});
+	auto byTree = outcome([&]() {
+		return evaluator.evalTree(tokens);
+	});
+	// Fed in pieces of random length, so that integers are split between
+	// them
+	auto byStream = outcome([&]() {
+		StreamTokenizer tokenizer;
+		reducer.reset();
+		auto push = [&](const Token &token) {
+			reducer.push(token);
+		};
+		for(size_t first = 0; first < expr.size(); ) {
+			const size_t length = std::min<size_t>(1 + rng() % 8, expr.size() - first);
+			tokenizer.feed(expr.data() + first, length, push);
+			first += length;
+		}
+		tokenizer.finish(push);
+		return reducer.finish();
+	});
+	return {byRange, byStack, byTree, byStream};
+}
+
+void printMismatch(const std::string &expr, const std::array<std::string, 4> &outcomes) {
+	std::cerr << "Mismatch: " << expr << "\n  eval:       " << outcomes[0]
+		<< "\n  stack eval: " << outcomes[1] << "\n  buildTree:  " << outcomes[2]
+		<< "\n  stream:     " << outcomes[3] << '\n';
+}
+
+template<typename Policy>
+size_t differential(size_t count, const Options &options, std::mt19937 &rng) {
+	size_t mismatches = 0;
+	Evaluator<Policy> evaluator;
+	StreamReducer<Policy> reducer;
+	for(size_t i = 0; i < count; i++) {
+		auto shape = static_cast<Shape>(rng() % shapeStrings.size() );
+		std::string expr = generate(shape, 1 + rng() % 64, options.mix, rng);
+		auto outcomes = strategies(expr, evaluator, reducer, rng);
+		if(std::count(outcomes.begin(), outcomes.end(), outcomes[0]) != 4 && ++mismatches <= 10) {
+			printMismatch(expr, outcomes);
+		}
+	}
+	return mismatches;
+}
+
+struct Literal {
+	std::string_view expr;
+	// Expected under int64 and big, auto takes the second when the first
+	// overflows
+	std::string_view narrow, wide;
+};
+
+// Literals around and beyond the range of int64_t, which only the policies
+// wide enough to hold them accept
+constexpr static std::array<Literal, 5> literals = {{
+	{"123456789012345678901234567890", "ERROR (integer overflow)", "123456789012345678901234567890"},
+	{"-9223372036854775808", "ERROR (integer overflow)", "-9223372036854775808"},
+	{"9223372036854775807", "9223372036854775807", "9223372036854775807"},
+	{"123456789012345678901234567890 - 123456789012345678901234567889", "ERROR (integer overflow)", "1"},
+	{"2 ^ 100000000000000000000", "ERROR (integer overflow)", "ERROR (exponent too large)"}
+}};
+
+size_t checkLiterals(std::mt19937 &rng) {
+	size_t mismatches = 0;
+	Evaluator<Int64> narrow;
+	Evaluator<Arbitrary> wide;
+	StreamReducer<Int64> narrowReducer;
+	StreamReducer<Arbitrary> wideReducer;
+	for(const Literal &literal : literals) {
+		const std::string expr(literal.expr);
+		auto byInt64 = strategies(expr, narrow, narrowReducer, rng);
+		auto byBig = strategies(expr, wide, wideReducer, rng);
+		Tokens tokens = tokenize(expr);
+		auto byAuto = outcome([&]() {
+			std::ostringstream os;
+			evalAuto(os, narrow, wide, tokens);
+			return os.str();
+		});
+		const bool overflows = literal.narrow == "ERROR (integer overflow)";
+		if(std::count(byInt64.begin(), byInt64.end(), literal.narrow) != 4) {
+			mismatches++;
+			std::cerr << "int64 expected " << literal.narrow << '\n';
+			printMismatch(expr, byInt64);
+		}
+		if(std::count(byBig.begin(), byBig.end(), literal.wide) != 4) {
+			mismatches++;
+			std::cerr << "big expected " << literal.wide << '\n';
+			printMismatch(expr, byBig);
+		}
+		if(byAuto != (overflows ? literal.wide : literal.narrow) ) {
+			mismatches++;
+			std::cerr << "auto differs on " << expr << ": " << byAuto << '\n';
+		}
+	}
+	return mismatches;
+}
+
+// Checks that every strategy agrees on the value of random expressions,
+// under every numeric policy, and reports how fast expressions are checked
+int fuzz(const Options &options) {
+	std::mt19937 rng(options.seed);
+	auto start = Clock::now();
+	size_t mismatches = differential<Float>(options.diff, options, rng)
+		+ differential<Int64>(options.diff, options, rng)
+		+ differential<Int128>(options.diff, options, rng)
+		+ differential<Arbitrary>(options.diff, options, rng)
+		+ checkLiterals(rng);
+	auto seconds = std::chrono::duration<double>(Clock::now() - start).count();
+
+	std::cout << options.diff * 4 << " expressions checked, " << mismatches
+		<< " mismatches, " << std::fixed << std::setprecision(0)
+		<< options.diff * 4 / seconds << " expressions/s\n";
+	return mismatches == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void usage(const char *name) {
+	std::cerr << "Usage: " << name << " [--shape random|flat|chain] [--length N]..."
+		" [--mix OPERATORS] [--budget TOKENS] [--diff COUNT] [--seed N]\n";
+}
+
+int main(int argc, char **argv) {
+	Options options;
+	bool shapeGiven = false, lengthGiven = false;
+	for(int i = 1; i < argc; i++) {
+		std::string_view arg = argv[i];
+		if(i + 1 == argc) {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+		std::string value = argv[++i];
+
+		if(arg == "--shape") {
+			auto it = std::find(shapeStrings.begin(), shapeStrings.end(), value);
+			if(it == shapeStrings.end() ) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			if(!shapeGiven) options.shapes.clear();
+			shapeGiven = true;
+			options.shapes.push_back(static_cast<Shape>(std::distance(shapeStrings.begin(), it) ) );
+		} else if(arg == "--length") {
+			if(!lengthGiven) options.lengths.clear();
+			lengthGiven = true;
+			options.lengths.push_back(std::stoul(value) );
+		} else if(arg == "--mix") {
+			auto valid = [](char c) {
+				return std::find(binaryOperators.begin(), binaryOperators.end(), c) != binaryOperators.end();
+			};
+			if(value.empty() || !std::all_of(value.begin(), value.end(), valid) ) {
+				usage(argv[0]);
+				return EXIT_FAILURE;
+			}
+			options.mix = value;
+		} else if(arg == "--budget") {
+			options.tokenBudget = std::stoul(value);
+		} else if(arg == "--diff") {
+			options.diff = std::stoul(value);
+		} else if(arg == "--seed") {
+			options.seed = std::stoul(value);
+		} else {
+			usage(argv[0]);
+			return EXIT_FAILURE;
+		}
+	}
+
+	if(options.diff > 0) {
+		return fuzz(options);
+	}
+	benchmark(options);
+	benchmarkPower(options.seed);
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,185 @@
+#include "calc.hpp"
+
+void printCarat(int index) {
+	for(auto c : prefix) std::cerr << ' ';
+	for(int i = 0; i < index; i++) std::cerr << ' ';
+	std::cerr << "^\n";
+}
+
+bool highPrecedence(int c) {
+	return c == '*' || c == '/';
+}
+
+int precedence(const Token &op) {
+	if(op.type == TokenType::UnaryOperator) return 3;
+	if(op.value == '^') return 4;
+	return highPrecedence(op.value) ? 2 : 1;
+}
+
+// Finds the operator in [first, last) that is applied last: the rightmost
+// + or -, else the rightmost * or /, else a leading unary operator and
+// finally the leftmost ^, which makes ^ right associative
+TokenIterator split(const TokenIterator first, const TokenIterator last) {
+	auto it = rfind(first, last, [](const Token t) {
+		return t.type == TokenType::BinaryOperator && !highPrecedence(t.value) && t.value != '^';
+	});
+
+	if(it == last) {
+		it = rfind(first, last, [](const Token t) {
+			return t.type == TokenType::BinaryOperator && highPrecedence(t.value);
+		});
+	}
+
+	if(it == last && first->type == TokenType::UnaryOperator) {
+		return first;
+	}
+
+	if(it == last) {
+		it = std::find_if(first, last, [](const Token t) {
+			return t.type == TokenType::BinaryOperator && t.value == '^';
+		});
+	}
+	return it;
+}
+
+void visit(Node *node) {
+	if(node->iterator->wide() ) std::cout << node->iterator->wideDigits() << '\n';
+	else std::cout << node->iterator->value << '\n';
+	if(!node->left && node->right) {
+		std::cout << "Operand: ";
+		visit(node->right);
+	} else if(node->left && node->right) {
+		std::cout << "Left: ";
+		visit(node->left);
+		std::cout << "Right: ";
+		visit(node->right);
+	}
+}
+
+// Rotates left children up until there are none, then frees the node and
+// continues to the right, so no stack is needed at all
+void destroy(Node *node) {
+	while(node) {
+		if(node->left) {
+			Node *left = node->left;
+			node->left = left->right;
+			left->right = node;
+			node = left;
+		} else {
+			Node *right = node->right;
+			delete node;
+			node = right;
+		}
+	}
+}
+
+void printTokens(const Tokens &tokens) {
+	for(auto t : tokens) {
+		if(t.wide() ) std::cout << t.wideDigits() << ' ';
+		else if(t.type == TokenType::Integer) std::cout << t.value << ' ';
+		else std::cout << static_cast<char>(t.value) << ' ';
+	}
+	std::cout << "\n\n";
+}
+
+Node *TreeBuilder::build(const TokenIterator first, const TokenIterator last) {
+	if(first == last) return nullptr;
+	nodes.clear();
+	try {
+		shunt(first, last, operators, maxDepth, [this](TokenIterator it) {
+			nodes.push_back(new Node{it});
+		}, [this](TokenIterator op) {
+			Node *node = new Node{op};
+			node->right = nodes.back();
+			if(op->type == TokenType::UnaryOperator) {
+				nodes.back() = node;
+				return;
+			}
+			nodes.pop_back();
+			node->left = nodes.back();
+			nodes.back() = node;
+		});
+	} catch(...) {
+		for(auto node : nodes) destroy(node);
+		throw;
+	}
+	return nodes.back();
+}
+
+Tokens tokenize(const std::string &input) {
+	auto current = input.begin();
+	auto start = current;
+	auto binOp = binaryOperators.begin();
+	Tokens tokens;
+	Token token;
+
+	TokenType expected = TokenType::Integer;
+
+	auto expecting = [&](TokenType type) {
+		if(type == expected) return true;
+		printCarat(std::distance(input.begin(), current) );
+		return false;
+	};
+
+	for(; current < input.end(); current++) {
+		while(current != input.end() && std::isspace(*current) ) ++current;
+		if(current == input.end() ) break;
+
+		start = current;
+		token.digits = nullptr;
+		auto unOp = std::find(unaryOperators.begin(), unaryOperators.end(), *current);
+		if(unOp != unaryOperators.end() && expected == TokenType::Integer) {
+			token.value = *unOp;
+			token.type = TokenType::UnaryOperator;
+			token.index = std::distance(input.begin(), current);
+			tokens.push_back(token);
+			continue;
+		}
+
+		if(std::isdigit(*current) ) {
+			token.index = std::distance(input.begin(), current);
+			if(!expecting(TokenType::Integer) ) {
+				return Tokens();
+			}
+			++current;
+			while(current != input.end() && std::isdigit(*current) ) ++current;
+			try {
+				token.value = std::stoll(std::string(start, current) );
+			} catch(const std::out_of_range &) {
+				// Kept as written for the policies wide enough to hold it
+				token.value = current - start;
+				token.digits = &*start;
+			}
+			if(token.wide() && token.value > static_cast<int64_t>(maxLiteralDigits) ) {
+				printCarat(token.index);
+				return Tokens();
+			}
+			token.type = TokenType::Integer;
+			tokens.push_back(token);
+			--current;
+			expected = TokenType::BinaryOperator;
+			continue;
+		} 
+
+		binOp = std::find(binaryOperators.begin(), binaryOperators.end(), *current);
+		if(binOp != binaryOperators.end() ) {
+			if(!expecting(TokenType::BinaryOperator) ) {
+				return Tokens();
+			}
+			token.value = *binOp;
+			token.type = TokenType::BinaryOperator;
+			token.index = std::distance(input.begin(), current);
+			tokens.push_back(token);
+			expected = TokenType::Integer;
+			continue;
+		}
+
+	}
+
+	if(!tokens.empty() && expected == TokenType::Integer) {
+		printCarat(tokens.back().index);
+		return Tokens();
+	}
+
+	return tokens;
+}
@@ -0,0 +1,335 @@
+#pragma once
+#include <algorithm>
+#include <array>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+#include "numeric.hpp"
+
+constexpr static std::string_view prefix = ">>>  ";
+
+constexpr static std::array<char, 5> binaryOperators = {
+	'+',
+	'-',
+	'*',
+	'/',
+	'^'
+};
+
+constexpr static std::array<char, 2> unaryOperators = {
+	'+',
+	'-'
+};
+
+constexpr static std::array<std::string_view, 3> tokenStrings = {
+	"Integer",
+	"BinaryOperator",
+	"UnaryOperator"
+};
+
+enum struct TokenType {
+	Integer,
+	BinaryOperator,
+	UnaryOperator
+};
+
+// index shares the alignment padding of type and an integer too large for
+// int64_t keeps its count of digits in value, so that a token stays 24 bytes
+struct Token {
+	TokenType type;
+	int index = -1;
+	int64_t value;
+	// The digits of an integer too large for value, null otherwise. They
+	// point into the text that was tokenized, which has to outlive the token
+	const char *digits = nullptr;
+
+	bool wide() const { return digits != nullptr; }
+	std::string_view wideDigits() const { return std::string_view(digits, value); }
+};
+
+using Tokens = std::vector<Token>;
+using TokenIterator = Tokens::iterator;
+
+struct Node {
+	TokenIterator iterator;
+	Node* left = nullptr;
+	Node* right = nullptr;
+};
+
+template<typename ForwardIterator, typename UnaryPredicate>
+ForwardIterator rfind(const ForwardIterator first, const ForwardIterator last, UnaryPredicate pred) {
+	auto rend = std::prev(first);
+	auto rbegin = std::prev(last);
+	for(; rbegin != rend; rbegin--) {
+		if(pred(*rbegin) ) return rbegin;
+	}
+	return last;
+}
+
+// Bounds the explicit stacks of the iterative walkers, an expression that
+// would need more raises NestingTooDeep instead
+constexpr static size_t defaultMaxDepth = 1 << 20;
+
+struct NestingTooDeep : public std::length_error {
+	NestingTooDeep() : std::length_error("expression nests too deep") {}
+};
+
+// The value of an integer token under Policy
+template<typename Policy>
+typename Policy::Value literalValue(const Token &token) {
+	using Value = typename Policy::Value;
+	return token.wide() ? Policy::parse(token.wideDigits() ) : Value(token.value);
+}
+
+void printCarat(int index);
+bool highPrecedence(int c);
+int precedence(const Token &op);
+TokenIterator split(const TokenIterator first, const TokenIterator last);
+void visit(Node *node);
+void destroy(Node *node);
+void printTokens(const Tokens &tokens);
+Tokens tokenize(const std::string &input);
+
+// Operator precedence parsing of [first, last) without recursion. push is
+// called for every operand and reduce for every operator once its operands
+// have been pushed, which is the order a post-order walk would visit them in.
+// Only operators waiting on a tighter binding right hand side are kept on the
+// stack, so chains of + - * / need constant space
+template<typename Push, typename Reduce>
+void shunt(const TokenIterator first, const TokenIterator last,
+		std::vector<TokenIterator> &operators, size_t maxDepth, Push push, Reduce reduce) {
+	operators.clear();
+	for(auto it = first; it != last; it++) {
+		if(it->type == TokenType::Integer) {
+			push(it);
+			continue;
+		}
+		if(it->type == TokenType::BinaryOperator) {
+			const int prec = precedence(*it);
+			const bool rightAssociative = it->value == '^';
+			while(!operators.empty() ) {
+				const int top = precedence(*operators.back() );
+				if(top < prec || (top == prec && rightAssociative) ) {
+					break;
+				}
+				reduce(operators.back() );
+				operators.pop_back();
+			}
+		}
+		if(operators.size() >= maxDepth) {
+			throw NestingTooDeep();
+		}
+		operators.push_back(it);
+	}
+	while(!operators.empty() ) {
+		reduce(operators.back() );
+		operators.pop_back();
+	}
+}
+
+// Builds the same tree as the recursive split would, with the stacks kept
+// between calls so that rebuilding does not reallocate them
+class TreeBuilder {
+public:
+	explicit TreeBuilder(size_t maxDepth = defaultMaxDepth) : maxDepth(maxDepth) {}
+	Node *build(const TokenIterator first, const TokenIterator last);
+private:
+	std::vector<Node*> nodes;
+	std::vector<TokenIterator> operators;
+	size_t maxDepth;
+};
+
+// Literal exponents up to this bound are dispatched to a multiplication chain
+// unrolled at compile time, larger ones to square-and-multiply
+constexpr static int fixedPowerLimit = 16;
+
+// The chains multiply through Policy::multiply rather than Policy::calc, so
+// that each one inlines to bare multiplications. raise() is forced inline,
+// called out of line it costs more than square-and-multiply saves for small
+// exponents. Overflow is collected over the chain and thrown once at the
+// end, so that the seventeen chains share one throw
+template<typename Policy>
+[[gnu::always_inline]] inline typename Policy::Value raise(const typename Policy::Value &base, int64_t exp) {
+	using Value = typename Policy::Value;
+	if(exp < 0 || exp > fixedPowerLimit) {
+		return Policy::calc(base, Value(exp), '^');
+	}
+	bool overflow = false;
+	auto mul = [&overflow](const Value &op1, const Value &op2) {
+		Value result;
+		overflow |= Policy::multiply(op1, op2, result);
+		return result;
+	};
+	static_assert(fixedPowerLimit == 16, "the cases below stop at 16");
+	Value result;
+	switch(exp) {
+		case 0: result = power<0>(base, mul); break;
+		case 1: result = power<1>(base, mul); break;
+		case 2: result = power<2>(base, mul); break;
+		case 3: result = power<3>(base, mul); break;
+		case 4: result = power<4>(base, mul); break;
+		case 5: result = power<5>(base, mul); break;
+		case 6: result = power<6>(base, mul); break;
+		case 7: result = power<7>(base, mul); break;
+		case 8: result = power<8>(base, mul); break;
+		case 9: result = power<9>(base, mul); break;
+		case 10: result = power<10>(base, mul); break;
+		case 11: result = power<11>(base, mul); break;
+		case 12: result = power<12>(base, mul); break;
+		case 13: result = power<13>(base, mul); break;
+		case 14: result = power<14>(base, mul); break;
+		case 15: result = power<15>(base, mul); break;
+		case 16: result = power<16>(base, mul); break;
+	}
+	if(__builtin_expect(overflow, false) ) {
+		throw Overflow();
+	}
+	return result;
+}
+
+// Recursive reference evaluator, splits at the operator applied last. Its
+// depth follows the expression, Evaluator is the stack safe alternative
+template<typename Policy>
+typename Policy::Value eval(const TokenIterator first, const TokenIterator last) {
+	using Value = typename Policy::Value;
+	if(first == last) return Value(0);
+	if(first + 1 == last) return literalValue<Policy>(*first);
+
+	auto it = split(first, last);
+	if(it->type == TokenType::UnaryOperator) {
+		return Policy::calc(Value(0), eval<Policy>(std::next(it), last), it->value);
+	}
+
+	auto op1 = eval<Policy>(first, it);
+	if(it->value == '^' && std::next(it, 2) == last && !std::next(it)->wide() ) {
+		return raise<Policy>(op1, std::next(it)->value);
+	}
+	auto op2 = eval<Policy>(std::next(it), last);
+	return Policy::calc(op1, op2, it->value);
+}
+
+// Iterative evaluation of token ranges and trees. The stacks are members so
+// their capacity is retained from one expression to the next
+template<typename Policy>
+class Evaluator {
+public:
+	using Value = typename Policy::Value;
+
+	explicit Evaluator(size_t maxDepth = defaultMaxDepth) : builder(maxDepth), maxDepth(maxDepth) {}
+
+	Value eval(const TokenIterator first, const TokenIterator last) {
+		if(first == last) return Value(0);
+		operands.clear();
+		shunt(first, last, operators, maxDepth, [this](TokenIterator it) {
+			operands.push_back({literalValue<Policy>(*it), it->wide() ? nullptr : &*it});
+		}, [this](TokenIterator op) {
+			Operand rhs = std::move(operands.back() );
+			operands.pop_back();
+			if(op->type == TokenType::UnaryOperator) {
+				operands.push_back({Policy::calc(Value(0), rhs.value, op->value), nullptr});
+				return;
+			}
+			Operand &lhs = operands.back();
+			lhs.value = op->value == '^' && rhs.literal
+				? raise<Policy>(lhs.value, rhs.literal->value)
+				: Policy::calc(lhs.value, rhs.value, op->value);
+			lhs.literal = nullptr;
+		});
+		return std::move(operands.back().value);
+	}
+
+	Value eval(Node *root) {
+		values.clear();
+		frames.clear();
+		frames.push_back({root, false});
+		while(!frames.empty() ) {
+			Frame frame = frames.back();
+			frames.pop_back();
+			Node *node = frame.node;
+			const Token &token = *node->iterator;
+
+			if(token.type == TokenType::Integer) {
+				values.push_back(literalValue<Policy>(token) );
+				continue;
+			}
+
+			if(!frame.expanded) {
+				if(frames.size() + 3 > 2 * maxDepth) {
+					throw NestingTooDeep();
+				}
+				frames.push_back({node, true});
+				if(!literalExponent(node) ) {
+					frames.push_back({node->right, false});
+				}
+				if(node->left) {
+					frames.push_back({node->left, false});
+				}
+				continue;
+			}
+
+			if(token.type == TokenType::UnaryOperator) {
+				values.back() = Policy::calc(Value(0), values.back(), token.value);
+			} else if(literalExponent(node) ) {
+				values.back() = raise<Policy>(values.back(), node->right->iterator->value);
+			} else {
+				Value rhs = std::move(values.back() );
+				values.pop_back();
+				values.back() = Policy::calc(values.back(), rhs, token.value);
+			}
+		}
+		return std::move(values.back() );
+	}
+
+	Value evalTree(Tokens &tokens) {
+		if(tokens.empty() ) return Value(0);
+		Node *root = builder.build(tokens.begin(), tokens.end() );
+		Value value;
+		try {
+			value = eval(root);
+		} catch(...) {
+			destroy(root);
+			throw;
+		}
+		destroy(root);
+		return value;
+	}
+
+private:
+	struct Operand {
+		Value value;
+		const Token *literal;
+	};
+
+	struct Frame {
+		Node *node;
+		bool expanded;
+	};
+
+	static bool literalExponent(const Node *node) {
+		return node->iterator->value == '^' && node->iterator->type == TokenType::BinaryOperator
+			&& node->right->iterator->type == TokenType::Integer && !node->right->iterator->wide();
+	}
+
+	TreeBuilder builder;
+	std::vector<Operand> operands;
+	std::vector<TokenIterator> operators;
+	std::vector<Value> values;
+	std::vector<Frame> frames;
+	size_t maxDepth;
+};
+
+// Nearly everything fits in 64 bits, only pays for the bignum representation
+// once the native path has actually overflowed
+inline void evalAuto(std::ostream &os, Evaluator<Int64> &narrow, Evaluator<Arbitrary> &wide, Tokens &tokens) {
+	try {
+		os << narrow.eval(tokens.begin(), tokens.end() );
+	} catch(const Overflow &) {
+		os << wide.eval(tokens.begin(), tokens.end() );
+	}
+}
@@ -1,239 +1,208 @@
-#include <algorithm>
-#include <array>
-#include <iostream>
-#include <numeric>
-#include <string>
-#include <string_view>
-#include <vector>
-
-constexpr std::string_view prefix = ">>>  ";
-
-constexpr static std::array<char, 4> binaryOperators = {
-	'+',
-	'-',
-	'*',
-	'/'
-};
+#include "calc.hpp"
+#include "stream.hpp"
 
-constexpr static std::array<std::string_view, 2> tokenStrings = {
-	"Integer",
-	"BinaryOperator"
-};
+#include <chrono>
+#include <cstring>
 
-enum struct TokenType {
-	Integer,
-	BinaryOperator
-};
+#include <fcntl.h>
 
-struct Token {
-	TokenType type;
-	int value;
-	int index = -1;
+enum struct Mode {
+	Float,
+	Int64,
+	Int128,
+	Arbitrary,
+	Auto
 };
 
-using Tokens = std::vector<Token>;
-using TokenIterator = Tokens::iterator;
-
-struct Node {
-	TokenIterator iterator;
-	Node* left = nullptr;
-	Node* right = nullptr;
+constexpr static std::array<std::string_view, 5> modeStrings = {
+	"float",
+	"int64",
+	"int128",
+	"big",
+	"auto"
 };
 
-template<typename ForwardIterator, typename UnaryPredicate>
-ForwardIterator rfind(const ForwardIterator first, const ForwardIterator last, UnaryPredicate pred) {
-	auto rend = std::prev(first);
-	auto rbegin = std::prev(last);
-	for(; rbegin != rend; rbegin--) {
-		if(pred(*rbegin) ) return rbegin;
-	}
-	return last;
-}
-
-void printCarat(int index) {
-	for(auto c : prefix) std::cerr << ' ';
-	for(int i = 0; i < index; i++) std::cerr << ' ';
-	std::cerr << "^\n";
-}
+// One evaluator per policy, kept for the whole session so that their stacks
+// are only grown once
+struct Evaluators {
+	explicit Evaluators(size_t maxDepth) 
+		: floats(maxDepth), int64s(maxDepth), int128s(maxDepth), arbitrary(maxDepth) {}
+	Evaluator<Float> floats;
+	Evaluator<Int64> int64s;
+	Evaluator<Int128> int128s;
+	Evaluator<Arbitrary> arbitrary;
+};
 
-bool highPrecedence(int c) {
-	return c == '*' || c == '/';
+template<typename Policy>
+void evalInto(std::ostream &os, Evaluator<Policy> &evaluator, Tokens &tokens) {
+	os << evaluator.eval(tokens.begin(), tokens.end() );
 }
 
-float calc(float op1, float op2, int binOp) {
-	switch(binOp) {
-		case '+':
-			return op1 + op2;
-		case '-':
-			return op1 - op2;
-		case '*':
-			return op1 * op2;
-		case '/':
-			return op1 / op2;
+bool parse(const std::string &str, Mode mode, Evaluators &evaluators, std::ostream &os) {
+	Tokens tokens = tokenize(str);
+	if(tokens.empty() ) return false;
+	//printTokens(tokens);
+	//return evaluators.int64s.evalTree(tokens);
+	try {
+		switch(mode) {
+			case Mode::Float:
+				evalInto(os, evaluators.floats, tokens);
+				break;
+			case Mode::Int64:
+				evalInto(os, evaluators.int64s, tokens);
+				break;
+			case Mode::Int128:
+				evalInto(os, evaluators.int128s, tokens);
+				break;
+			case Mode::Arbitrary:
+				evalInto(os, evaluators.arbitrary, tokens);
+				break;
+			case Mode::Auto:
+				evalAuto(os, evaluators.int64s, evaluators.arbitrary, tokens);
+				break;
+		}
+	} catch(const std::exception &e) {
+		os << "ERROR (" << e.what() << ')';
 	}
-	return 0.f;
+	return true;
 }
 
-float eval(const TokenIterator first, const TokenIterator last) {
-	if(first == last) return 0.f;
-	if(first + 1 == last) return first->value;
-
-	auto it = rfind(first, last, [](const Token t) {
-		return t.type == TokenType::BinaryOperator && !highPrecedence(t.value);
+template<typename Policy>
+void streamInto(std::ostream &os, int fd, StreamTokenizer &tokenizer, size_t maxDepth) {
+	StreamReducer<Policy> reducer(maxDepth);
+	streamTokens(fd, tokenizer, [&](const Token &token) {
+		reducer.push(token);
 	});
-
-	if(it == last) {
-		it = rfind(first, last, [](const Token t) {
-			return t.type == TokenType::BinaryOperator && highPrecedence(t.value);
-		});
-	}
-
-	float op1 = eval(first, it);
-	float op2 = eval(std::next(it), last);
-	return calc(op1, op2, it->value);
+	os << reducer.finish();
 }
 
-float eval(Node *node) {
-	if(node->iterator->type == TokenType::BinaryOperator) {
-		float op1 = eval(node->left);
-		float op2 = eval(node->right);
-		return calc(op1, op2, node->iterator->value);
+// Starts out on 64 bits like parse() does, but what has been read cannot be
+// read again: on overflow the stacks so far are converted and the rest of the
+// stream goes to the arbitrary precision policy
+void streamAuto(std::ostream &os, int fd, StreamTokenizer &tokenizer, size_t maxDepth) {
+	StreamReducer<Int64> narrow(maxDepth);
+	std::optional<StreamReducer<Arbitrary>> wide;
+	streamTokens(fd, tokenizer, [&](const Token &token) {
+		if(wide) {
+			wide->push(token);
+			return;
+		}
+		try {
+			narrow.push(token);
+		} catch(const Overflow &) {
+			wide.emplace(narrow);
+			wide->push(token);
+		}
+	});
+	if(!wide) {
+		try {
+			os << narrow.finish();
+			return;
+		} catch(const Overflow &) {
+			wide.emplace(narrow);
+		}
 	}
-
-	return static_cast<float>(node->iterator->value);
+	os << wide->finish();
 }
 
-void visit(Node *node) {
-	std::cout << node->iterator->value << '\n';
-	if(node->left && node->right) {
-		std::cout << "Left: ";
-		visit(node->left);
-		std::cout << "Right: ";
-		visit(node->right);
+// Evaluates a whole file, or stdin for -, as one expression in constant
+// memory and reports how fast it was read
+int stream(const char *path, Mode mode, size_t maxDepth) {
+	const bool standardInput = std::string_view(path) == "-";
+	const int fd = standardInput ? STDIN_FILENO : open(path, O_RDONLY | O_CLOEXEC);
+	if(fd < 0) {
+		std::cerr << "Cannot read " << path << ": " << std::strerror(errno) << '\n';
+		return EXIT_FAILURE;
 	}
-}
-
-void destroy(Node *node) {
-	if(node->left) {
-		destroy(node->left);
+	StreamTokenizer tokenizer;
+	const auto start = std::chrono::steady_clock::now();
+	bool failed = false;
+	try {
+		switch(mode) {
+			case Mode::Float:
+				streamInto<Float>(std::cout, fd, tokenizer, maxDepth);
+				break;
+			case Mode::Int64:
+				streamInto<Int64>(std::cout, fd, tokenizer, maxDepth);
+				break;
+			case Mode::Int128:
+				streamInto<Int128>(std::cout, fd, tokenizer, maxDepth);
+				break;
+			case Mode::Arbitrary:
+				streamInto<Arbitrary>(std::cout, fd, tokenizer, maxDepth);
+				break;
+			case Mode::Auto:
+				streamAuto(std::cout, fd, tokenizer, maxDepth);
+				break;
+		}
+	} catch(const std::exception &e) {
+		std::cout << "ERROR (" << e.what() << ')';
+		failed = true;
 	}
-	if(node->right) {
-		destroy(node->right);
+	std::cout << '\n';
+	if(!standardInput) {
+		close(fd);
 	}
-	delete node;
-}
 
-void printTokens(const Tokens &tokens) {
-	for(auto t : tokens) {
-		std::cout << (t.type == TokenType::Integer 
-				? t.value : static_cast<char>(t.value) ) << ' ';
-	}
-	std::cout << "\n\n";
+	const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	const double megabytes = tokenizer.consumed() / 1e6;
+	std::cerr << tokenizer.consumed() << " bytes, " << tokenizer.tokens() << " tokens in "
+		<< seconds << " s, " << megabytes / std::max(seconds, 1e-9) << " MB/s\n";
+	return failed ? EXIT_FAILURE : EXIT_SUCCESS;
 }
 
-Node* buildTree(const TokenIterator first, const TokenIterator last) {
-	if(first == last) return nullptr;
-	if(first + 1 == last) return new Node{first};
-
-	auto it = rfind(first, last, [](const Token t) {
-		return t.type == TokenType::BinaryOperator && !highPrecedence(t.value);
-	});
-
-	if(it == last) {
-		it = rfind(first, last, [](const Token t) {
-			return t.type == TokenType::BinaryOperator && highPrecedence(t.value);
-		});
-	}
-
-	Node *node = new Node{it};
-	node->left = buildTree(first, it);
-	node->right = buildTree(std::next(it), last);
-	return node;
+void usage(const char *name) {
+	std::cerr << "Usage: " << name << " [--stream file] [float|int64|int128|big|auto] [max depth]\n";
 }
 
-float buildTree(Tokens &tokens) {
-	if(tokens.empty() ) return 0;
-	auto root = buildTree(tokens.begin(), tokens.end() );
-	float value = eval(root);
-	destroy(root);
-
-	return value;
+// Reads a count given on the command line, anything but digits that fit
+// is refused rather than thrown out of main
+bool parseCount(std::string_view text, size_t &count) {
+	if(text.empty() || !std::all_of(text.begin(), text.end(), [](char c) { return c >= '0' && c <= '9'; }) ) {
+		return false;
+	}
+	try {
+		count = std::stoull(std::string(text) );
+	} catch(const std::out_of_range &) {
+		return false;
+	}
+	return true;
 }
 
-Tokens tokenize(const std::string &input) {
-	auto current = input.begin();
-	auto start = current;
-	auto binOp = binaryOperators.begin();
-	Tokens tokens;
-	Token token;
-
-	TokenType expected = TokenType::Integer;
-
-	auto expecting = [&](TokenType type) {
-		if(type == expected) return true;
-		printCarat(std::distance(input.begin(), current) );
-		return false;
-	};
-
-	for(; current < input.end(); current++) {
-		while(current != input.end() && std::isspace(*current) ) ++current;
-		if(current == input.end() ) break;
-
-		start = current;
-		if(std::isdigit(*current) || (*current == '-' && (tokens.empty() || tokens.back().type != TokenType::Integer) ) ) {
-			token.index = std::distance(input.begin(), current);
-			if(!expecting(TokenType::Integer) ) {
-				return Tokens();
-			}
-			++current;
-			while(current != input.end() && std::isdigit(*current) ) ++current;
-			token.value = std::stoi(std::string(start, current) );
-			token.type = TokenType::Integer;
-			tokens.push_back(token);
-			--current;
-			expected = TokenType::BinaryOperator;
-			continue;
-		} 
-
-		binOp = std::find(binaryOperators.begin(), binaryOperators.end(), *current);
-		if(binOp != binaryOperators.end() ) {
-			if(!expecting(TokenType::BinaryOperator) ) {
-				return Tokens();
-			}
-			token.value = *binOp;
-			token.type = TokenType::BinaryOperator;
-			token.index = std::distance(input.begin(), current);
-			tokens.push_back(token);
-			expected = TokenType::Integer;
-			continue;
+int main(int argc, char **argv) {
+	Mode mode = Mode::Auto;
+	size_t maxDepth = defaultMaxDepth;
+	const char *name = argv[0], *streamPath = nullptr;
+	if(argc > 2 && std::string_view(argv[1]) == "--stream") {
+		streamPath = argv[2];
+		argc -= 2;
+		argv += 2;
+	}
+	if(argc > 1) {
+		auto it = std::find(modeStrings.begin(), modeStrings.end(), argv[1]);
+		if(it == modeStrings.end() ) {
+			usage(name);
+			return EXIT_FAILURE;
 		}
-
+		mode = static_cast<Mode>(std::distance(modeStrings.begin(), it) );
 	}
-
-	if(!tokens.empty() && expected == TokenType::Integer) {
-		printCarat(tokens.back().index);
-		return Tokens();
+	if(argc > 2 && !parseCount(argv[2], maxDepth) ) {
+		usage(name);
+		return EXIT_FAILURE;
 	}
 
-	return tokens;
-}
+	if(streamPath) {
+		return stream(streamPath, mode, maxDepth);
+	}
 
-float parse(const std::string &str) {
-	Tokens tokens = tokenize(str);
-	if(tokens.empty() ) return std::numeric_limits<float>::max();
-	//printTokens(tokens);
-	//return buildTree(tokens);
-	return eval(tokens.begin(), tokens.end() );
-}
+	Evaluators evaluators(maxDepth);
 
-int main() {
 	std::string input;
 	std::cout << prefix;
 	while(std::getline(std::cin, input) ) {
-		float value = parse(input);
 		std::cout << " = ";
-		if(value == std::numeric_limits<float>::max() ) std::cerr << "ERROR" << '\n';
-		else std::cerr << value << '\n';
+		if(!parse(input, mode, evaluators, std::cerr) ) std::cerr << "ERROR";
+		std::cerr << '\n';
 		std::cout << prefix;
 	}
 }
@@ -0,0 +1,503 @@
+#pragma once
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <ostream>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+#include "pow.hpp"
+
+// Thrown by the native integer policies when a result does not fit, so that
+// the caller may retry the expression with a wider policy
+struct Overflow : public std::overflow_error {
+	Overflow() : std::overflow_error("integer overflow") {}
+};
+
+struct DivisionByZero : public std::domain_error {
+	DivisionByZero() : std::domain_error("division by zero") {}
+};
+
+// Sign-magnitude integer of unbounded size, stored as little-endian 32-bit limbs
+class BigInt {
+public:
+	BigInt() = default;
+
+	BigInt(int64_t value) : negative(value < 0) {
+		uint64_t magnitude = negative ? 0 - static_cast<uint64_t>(value)
+			: static_cast<uint64_t>(value);
+		while(magnitude) {
+			limbs.push_back(static_cast<Limb>(magnitude) );
+			magnitude >>= 32;
+		}
+	}
+
+	// Value of a string of decimal digits, read nine at a time
+	static BigInt parse(std::string_view digits) {
+		Limbs limbs;
+		for(size_t first = 0; first < digits.size();) {
+			const size_t length = first == 0 && digits.size() % 9 ? digits.size() % 9 : 9;
+			Limb scale = 1, chunk = 0;
+			for(size_t i = first; i < first + length; i++) {
+				scale *= 10;
+				chunk = chunk * 10 + static_cast<Limb>(digits[i] - '0');
+			}
+			mulAddSmall(limbs, scale, chunk);
+			first += length;
+		}
+		return make(std::move(limbs), false);
+	}
+
+	bool isZero() const {
+		return limbs.empty();
+	}
+
+	// Bits of the magnitude, zero for zero
+	uint64_t bitLength() const {
+		return limbs.empty() ? 0 : limbs.size() * 32 - __builtin_clz(limbs.back() );
+	}
+
+	bool toInt64(int64_t &value) const {
+		if(limbs.size() > 2) {
+			return false;
+		}
+		uint64_t magnitude = 0;
+		for(size_t i = limbs.size(); i-- > 0;) {
+			magnitude = (magnitude << 32) | limbs[i];
+		}
+		const uint64_t limit = static_cast<uint64_t>(INT64_MAX) + negative;
+		if(magnitude > limit) {
+			return false;
+		}
+		value = negative ? static_cast<int64_t>(0 - magnitude) : static_cast<int64_t>(magnitude);
+		return true;
+	}
+
+	friend BigInt operator-(BigInt value) {
+		value.negative = !value.negative && !value.isZero();
+		return value;
+	}
+
+	friend BigInt operator+(const BigInt &lhs, const BigInt &rhs) {
+		if(lhs.negative == rhs.negative) {
+			return make(addMagnitude(lhs.limbs, rhs.limbs), lhs.negative);
+		}
+		if(compareMagnitude(lhs.limbs, rhs.limbs) >= 0) {
+			return make(subMagnitude(lhs.limbs, rhs.limbs), lhs.negative);
+		}
+		return make(subMagnitude(rhs.limbs, lhs.limbs), rhs.negative);
+	}
+
+	friend BigInt operator-(const BigInt &lhs, const BigInt &rhs) {
+		return lhs + -rhs;
+	}
+
+	friend BigInt operator*(const BigInt &lhs, const BigInt &rhs) {
+		return make(mulMagnitude(lhs.limbs, rhs.limbs), lhs.negative != rhs.negative);
+	}
+
+	// Truncates towards zero, like the built-in integer division
+	friend BigInt operator/(const BigInt &lhs, const BigInt &rhs) {
+		if(rhs.isZero() ) {
+			throw DivisionByZero();
+		}
+		return make(divMagnitude(lhs.limbs, rhs.limbs), lhs.negative != rhs.negative);
+	}
+
+	friend bool operator==(const BigInt &lhs, const BigInt &rhs) {
+		return lhs.negative == rhs.negative && lhs.limbs == rhs.limbs;
+	}
+
+	friend bool operator!=(const BigInt &lhs, const BigInt &rhs) {
+		return !(lhs == rhs);
+	}
+
+	std::string toString() const {
+		if(isZero() ) {
+			return "0";
+		}
+		std::string digits;
+		std::vector<Limb> rest = limbs;
+		while(!rest.empty() ) {
+			Limb chunk = divSmall(rest, 1000000000u);
+			for(int i = 0; i < 9 && (chunk || !rest.empty() ); i++) {
+				digits.push_back(static_cast<char>('0' + chunk % 10) );
+				chunk /= 10;
+			}
+		}
+		if(negative) {
+			digits.push_back('-');
+		}
+		std::reverse(digits.begin(), digits.end() );
+		return digits;
+	}
+
+private:
+	using Limb = uint32_t;
+	using Wide = uint64_t;
+	using Limbs = std::vector<Limb>;
+
+	static BigInt make(Limbs &&limbs, bool negative) {
+		BigInt value;
+		value.limbs = std::move(limbs);
+		trim(value.limbs);
+		value.negative = negative && !value.isZero();
+		return value;
+	}
+
+	static void trim(Limbs &limbs) {
+		while(!limbs.empty() && limbs.back() == 0) {
+			limbs.pop_back();
+		}
+	}
+
+	static int compareMagnitude(const Limbs &lhs, const Limbs &rhs) {
+		if(lhs.size() != rhs.size() ) {
+			return lhs.size() < rhs.size() ? -1 : 1;
+		}
+		for(size_t i = lhs.size(); i-- > 0;) {
+			if(lhs[i] != rhs[i]) {
+				return lhs[i] < rhs[i] ? -1 : 1;
+			}
+		}
+		return 0;
+	}
+
+	static Limbs addMagnitude(const Limbs &lhs, const Limbs &rhs) {
+		const Limbs &longer = lhs.size() < rhs.size() ? rhs : lhs;
+		const Limbs &shorter = lhs.size() < rhs.size() ? lhs : rhs;
+		Limbs result(longer.size() + 1);
+		Wide carry = 0;
+		for(size_t i = 0; i < longer.size(); i++) {
+			carry += static_cast<Wide>(longer[i]) + (i < shorter.size() ? shorter[i] : 0);
+			result[i] = static_cast<Limb>(carry);
+			carry >>= 32;
+		}
+		result.back() = static_cast<Limb>(carry);
+		return result;
+	}
+
+	// Requires |lhs| >= |rhs|
+	static Limbs subMagnitude(const Limbs &lhs, const Limbs &rhs) {
+		Limbs result(lhs.size() );
+		int64_t borrow = 0;
+		for(size_t i = 0; i < lhs.size(); i++) {
+			int64_t diff = static_cast<int64_t>(lhs[i]) - borrow
+				- (i < rhs.size() ? rhs[i] : 0);
+			borrow = diff < 0;
+			result[i] = static_cast<Limb>(diff + (borrow << 32) );
+		}
+		return result;
+	}
+
+	static Limbs mulMagnitude(const Limbs &lhs, const Limbs &rhs) {
+		if(lhs.empty() || rhs.empty() ) {
+			return Limbs();
+		}
+		Limbs result(lhs.size() + rhs.size() );
+		for(size_t i = 0; i < lhs.size(); i++) {
+			Wide carry = 0;
+			for(size_t j = 0; j < rhs.size(); j++) {
+				carry += static_cast<Wide>(lhs[i]) * rhs[j] + result[i + j];
+				result[i + j] = static_cast<Limb>(carry);
+				carry >>= 32;
+			}
+			result[i + rhs.size()] = static_cast<Limb>(carry);
+		}
+		return result;
+	}
+
+	static void mulAddSmall(Limbs &limbs, Limb factor, Limb addend) {
+		Wide carry = addend;
+		for(Limb &limb : limbs) {
+			carry += static_cast<Wide>(limb) * factor;
+			limb = static_cast<Limb>(carry);
+			carry >>= 32;
+		}
+		if(carry) {
+			limbs.push_back(static_cast<Limb>(carry) );
+		}
+	}
+
+	// Divides limbs in place, returns the remainder
+	static Limb divSmall(Limbs &limbs, Limb divisor) {
+		Wide remainder = 0;
+		for(size_t i = limbs.size(); i-- > 0;) {
+			remainder = (remainder << 32) | limbs[i];
+			limbs[i] = static_cast<Limb>(remainder / divisor);
+			remainder %= divisor;
+		}
+		trim(limbs);
+		return static_cast<Limb>(remainder);
+	}
+
+	// Knuth, TAOCP vol. 2, 4.3.1, algorithm D
+	static Limbs divMagnitude(const Limbs &lhs, const Limbs &rhs) {
+		if(compareMagnitude(lhs, rhs) < 0) {
+			return Limbs();
+		}
+		if(rhs.size() == 1) {
+			Limbs quotient = lhs;
+			divSmall(quotient, rhs.front() );
+			return quotient;
+		}
+
+		const size_t n = rhs.size();
+		const size_t m = lhs.size() - n;
+		const int shift = __builtin_clz(rhs.back() );
+
+		auto normalize = [shift](const Limbs &in, size_t size) {
+			Limbs out(size);
+			for(size_t i = 0; i < in.size(); i++) {
+				out[i] |= in[i] << shift;
+				if(shift && i + 1 < size) {
+					out[i + 1] = static_cast<Limb>(static_cast<Wide>(in[i]) >> (32 - shift) );
+				}
+			}
+			return out;
+		};
+		Limbs v = normalize(rhs, n);
+		Limbs u = normalize(lhs, lhs.size() + 1);
+		Limbs quotient(m + 1);
+
+		constexpr Wide base = Wide(1) << 32;
+		for(size_t j = m + 1; j-- > 0;) {
+			Wide numerator = (static_cast<Wide>(u[j + n]) << 32) | u[j + n - 1];
+			Wide qhat = numerator / v[n - 1];
+			Wide rhat = numerator % v[n - 1];
+			while(qhat >= base || qhat * v[n - 2] > ((rhat << 32) | u[j + n - 2]) ) {
+				--qhat;
+				rhat += v[n - 1];
+				if(rhat >= base) {
+					break;
+				}
+			}
+
+			int64_t borrow = 0;
+			Wide carry = 0;
+			for(size_t i = 0; i < n; i++) {
+				carry += qhat * v[i];
+				int64_t diff = static_cast<int64_t>(u[i + j]) - borrow
+					- static_cast<Limb>(carry);
+				carry >>= 32;
+				borrow = diff < 0;
+				u[i + j] = static_cast<Limb>(diff + (borrow << 32) );
+			}
+			int64_t diff = static_cast<int64_t>(u[j + n]) - borrow - static_cast<int64_t>(carry);
+			u[j + n] = static_cast<Limb>(diff);
+
+			if(diff < 0) {
+				--qhat;
+				Wide sum = 0;
+				for(size_t i = 0; i < n; i++) {
+					sum += static_cast<Wide>(u[i + j]) + v[i];
+					u[i + j] = static_cast<Limb>(sum);
+					sum >>= 32;
+				}
+				u[j + n] += static_cast<Limb>(sum);
+			}
+			quotient[j] = static_cast<Limb>(qhat);
+		}
+		return quotient;
+	}
+
+	Limbs limbs;
+	bool negative = false;
+};
+
+inline std::ostream &operator<<(std::ostream &os, const BigInt &value) {
+	return os << value.toString();
+}
+
+inline std::ostream &operator<<(std::ostream &os, __int128 value) {
+	if(value == 0) {
+		return os << '0';
+	}
+	std::string digits;
+	const bool negative = value < 0;
+	while(value != 0) {
+		int digit = static_cast<int>(value % 10);
+		digits.push_back(static_cast<char>('0' + (negative ? -digit : digit) ) );
+		value /= 10;
+	}
+	if(negative) {
+		digits.push_back('-');
+	}
+	std::reverse(digits.begin(), digits.end() );
+	return os << digits;
+}
+
+struct ExponentTooLarge : public std::range_error {
+	ExponentTooLarge() : std::range_error("exponent too large") {}
+};
+
+// Largest power Arbitrary computes, a few input bytes must not be able to
+// ask for minutes of multiplication
+constexpr static uint64_t maxPowerBits = 1 << 18;
+
+struct ResultTooLarge : public std::range_error {
+	ResultTooLarge() : std::range_error("result too large") {}
+};
+
+// Longest literal the tokenizers accept, as many digits as maxPowerBits
+// bits. Parsing one is quadratic in its length
+constexpr static size_t maxLiteralDigits = maxPowerBits * 30103 / 100000;
+
+// Literals too large for int64_t are read from their digits, the native
+// integer policies report them as Overflow like any other result that does
+// not fit
+template<typename T>
+T checkedParse(std::string_view digits) {
+	T result = 0;
+	for(char c : digits) {
+		if(__builtin_mul_overflow(result, 10, &result) || __builtin_add_overflow(result, c - '0', &result) ) {
+			throw Overflow();
+		}
+	}
+	return result;
+}
+
+// Shared by the native integer policies, overflow is detected through the
+// flag the hardware already computes rather than by widening
+template<typename T>
+T checkedCalc(T op1, T op2, int binOp) {
+	T result = 0;
+	bool overflow = false;
+	switch(binOp) {
+		case '+':
+			overflow = __builtin_add_overflow(op1, op2, &result);
+			break;
+		case '-':
+			overflow = __builtin_sub_overflow(op1, op2, &result);
+			break;
+		case '*':
+			overflow = __builtin_mul_overflow(op1, op2, &result);
+			break;
+		case '/':
+			if(op2 == 0) {
+				throw DivisionByZero();
+			}
+			if(op2 == -1) {
+				overflow = __builtin_sub_overflow(T(0), op1, &result);
+			} else {
+				result = op1 / op2;
+			}
+			break;
+		case '^':
+			if(op2 > INT64_MAX) {
+				throw Overflow();
+			}
+			return power(op1, static_cast<int64_t>(op2), [](T lhs, T rhs) {
+				return checkedCalc(lhs, rhs, '*');
+			});
+	}
+	if(__builtin_expect(overflow, false) ) {
+		throw Overflow();
+	}
+	return result;
+}
+
+// Numeric policies for the evaluator, each one names the value type and how
+// a single binary operator is applied to it. multiply is '*' on its own for
+// the multiplication chains of raise(), returning whether it overflowed.
+// parse reads a literal too large for int64_t
+
+struct Float {
+	using Value = float;
+	static Value calc(Value op1, Value op2, int binOp) {
+		switch(binOp) {
+			case '+':
+				return op1 + op2;
+			case '-':
+				return op1 - op2;
+			case '*':
+				return op1 * op2;
+			case '/':
+				if(op2 == 0.f) {
+					throw DivisionByZero();
+				}
+				return op1 / op2;
+			case '^':
+				if(std::trunc(op2) == op2 && std::fabs(op2) < 0x1p62f) {
+					return power(op1, static_cast<int64_t>(op2) );
+				}
+				return std::pow(op1, op2);
+		}
+		return 0.f;
+	}
+	static bool multiply(Value op1, Value op2, Value &result) {
+		result = op1 * op2;
+		return false;
+	}
+	static Value parse(std::string_view digits) {
+		return std::strtof(std::string(digits).c_str(), nullptr);
+	}
+};
+
+struct Int64 {
+	using Value = int64_t;
+	static Value calc(Value op1, Value op2, int binOp) {
+		return checkedCalc(op1, op2, binOp);
+	}
+	static bool multiply(Value op1, Value op2, Value &result) {
+		return __builtin_mul_overflow(op1, op2, &result);
+	}
+	static Value parse(std::string_view digits) {
+		return checkedParse<Value>(digits);
+	}
+};
+
+struct Int128 {
+	using Value = __int128;
+	static Value calc(Value op1, Value op2, int binOp) {
+		return checkedCalc(op1, op2, binOp);
+	}
+	static bool multiply(Value op1, Value op2, Value &result) {
+		return __builtin_mul_overflow(op1, op2, &result);
+	}
+	static Value parse(std::string_view digits) {
+		return checkedParse<Value>(digits);
+	}
+};
+
+struct Arbitrary {
+	using Value = BigInt;
+	static Value calc(const Value &op1, const Value &op2, int binOp) {
+		switch(binOp) {
+			case '+':
+				return op1 + op2;
+			case '-':
+				return op1 - op2;
+			case '*':
+				return op1 * op2;
+			case '/':
+				return op1 / op2;
+			case '^': {
+				int64_t exp = 0;
+				if(!op2.toInt64(exp) ) {
+					throw ExponentTooLarge();
+				}
+				// |op1|^exp has at least exp * (bitLength - 1) bits, bases of
+				// magnitude 0 and 1 stay small whatever the exponent
+				const uint64_t bits = op1.bitLength();
+				if(exp > 0 && bits > 1 && static_cast<uint64_t>(exp) > maxPowerBits / (bits - 1) ) {
+					throw ResultTooLarge();
+				}
+				return power(op1, exp, [](const Value &lhs, const Value &rhs) {
+					return lhs * rhs;
+				});
+			}
+		}
+		return Value();
+	}
+	static bool multiply(const Value &op1, const Value &op2, Value &result) {
+		result = op1 * op2;
+		return false;
+	}
+	static Value parse(std::string_view digits) {
+		return BigInt::parse(digits);
+	}
+};
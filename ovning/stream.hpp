@@ -0,0 +1,259 @@
+#pragma once
+#include <array>
+#include <cerrno>
+#include <optional>
+#include <system_error>
+
+#include <unistd.h>
+
+#include "calc.hpp"
+
+// Streams are read in blocks of this size, whatever the length of the input
+constexpr static size_t streamBlockSize = 1 << 16;
+
+// Thrown by the streaming tokenizer, which has no line to point a carat at
+struct SyntaxError : public std::invalid_argument {
+	SyntaxError(const std::string &what, uint64_t offset)
+		: std::invalid_argument(what + " at byte " + std::to_string(offset) ) {}
+};
+
+// What the streaming tokenizer makes of a byte. Whitespace and unknown
+// characters are both skipped, they only end an integer
+enum struct ByteClass : uint8_t {
+	Skipped,
+	Digit,
+	Operator
+};
+
+constexpr std::array<ByteClass, 256> makeByteClasses() {
+	std::array<ByteClass, 256> classes = {};
+	for(int c = '0'; c <= '9'; c++) {
+		classes[c] = ByteClass::Digit;
+	}
+	for(char c : binaryOperators) {
+		classes[static_cast<unsigned char>(c)] = ByteClass::Operator;
+	}
+	return classes;
+}
+
+constexpr static std::array<ByteClass, 256> byteClasses = makeByteClasses();
+
+// Tokenizes input that arrives in pieces, accepting what tokenize() accepts:
+// whitespace and any other character that is neither a digit nor an
+// operator separate tokens. Only the integer being read is kept from one
+// piece to the next, as its digits once it is too large for int64_t
+class StreamTokenizer {
+public:
+	template<typename Sink>
+	void feed(const char *data, size_t size, Sink sink) {
+		for(size_t i = 0; i < size; i++, offset++) {
+			const unsigned char c = data[i];
+			const ByteClass kind = byteClasses[c];
+			if(reading) {
+				if(kind == ByteClass::Digit) {
+					int64_t next;
+					if(__builtin_mul_overflow(integer, 10, &next)
+						|| __builtin_add_overflow(next, c - '0', &next) || !digits.empty() ) {
+						widen(c);
+					} else {
+						integer = next;
+					}
+					continue;
+				}
+				emitInteger(sink);
+			}
+			if(kind == ByteClass::Digit) {
+				if(expected != TokenType::Integer) {
+					throw SyntaxError("expected an operator", offset);
+				}
+				reading = true;
+				integer = c - '0';
+				start = offset;
+			} else if(kind == ByteClass::Operator) {
+				const bool unary = std::find(unaryOperators.begin(), unaryOperators.end(), c) != unaryOperators.end();
+				if(unary && expected == TokenType::Integer) {
+					emit(sink, Token{TokenType::UnaryOperator, -1, c});
+				} else if(expected != TokenType::BinaryOperator) {
+					throw SyntaxError("expected an integer", offset);
+				} else {
+					emit(sink, Token{TokenType::BinaryOperator, -1, c});
+					expected = TokenType::Integer;
+				}
+			}
+		}
+	}
+
+	// Ends the input, an expression may not end with an operator
+	template<typename Sink>
+	void finish(Sink sink) {
+		if(reading) {
+			emitInteger(sink);
+		}
+		if(count > 0 && expected == TokenType::Integer) {
+			throw SyntaxError("expected an integer", offset);
+		}
+	}
+
+	uint64_t consumed() const { return offset; }
+	uint64_t tokens() const { return count; }
+private:
+	// Once the integer no longer fits its digits are kept instead, integer
+	// holds the part read before that
+	[[gnu::noinline]] void widen(unsigned char c) {
+		if(digits.empty() ) {
+			digits = std::to_string(integer);
+		}
+		if(digits.size() == maxLiteralDigits) {
+			throw SyntaxError("integer too large", start);
+		}
+		digits.push_back(static_cast<char>(c) );
+	}
+
+	// The digits of a wide literal are only valid until the sink returns, it
+	// takes the value of the literal when it is handed the token
+	template<typename Sink>
+	void emitInteger(Sink &sink) {
+		reading = false;
+		expected = TokenType::BinaryOperator;
+		if(__builtin_expect(digits.empty(), true) ) {
+			emit(sink, Token{TokenType::Integer, -1, integer});
+			return;
+		}
+		emit(sink, Token{TokenType::Integer, -1, static_cast<int64_t>(digits.size() ), digits.data()});
+		digits.clear();
+	}
+
+	template<typename Sink>
+	void emit(Sink &sink, const Token &token) {
+		count++;
+		sink(token);
+	}
+
+	TokenType expected = TokenType::Integer;
+	bool reading = false;
+	int64_t integer = 0;
+	std::string digits;
+	uint64_t count = 0;
+	uint64_t start = 0;
+	uint64_t offset = 0;
+};
+
+// Operator precedence reduction of a stream of tokens, applying every
+// operator as soon as the precedence of the next one shows that it can be.
+// Evaluates to the same value as Evaluator::eval() but needs no token range:
+// an operator only stays on the stack while it waits on a tighter binding
+// right hand side, so however long a chain of + - * / is the stacks hold at
+// most three operands. Unary operators and ^ nest, bounded by maxDepth
+template<typename Policy>
+class StreamReducer {
+public:
+	using Value = typename Policy::Value;
+
+	explicit StreamReducer(size_t maxDepth = defaultMaxDepth) : maxDepth(maxDepth) {}
+
+	// Carries on where a reducer with a narrower policy stopped, so that an
+	// expression can be promoted once it overflows without reading it again
+	template<typename Narrow>
+	explicit StreamReducer(const StreamReducer<Narrow> &narrow)
+		: operators(narrow.operators), maxDepth(narrow.maxDepth) {
+		operands.reserve(narrow.operands.size() );
+		for(auto &operand : narrow.operands) {
+			operands.push_back({Value(operand.value), operand.literal});
+		}
+	}
+
+	void push(const Token &token) {
+		if(token.type == TokenType::Integer) {
+			operands.push_back({literalValue<Policy>(token),
+				token.wide() ? std::nullopt : std::optional<int64_t>(token.value)});
+			return;
+		}
+		if(token.type == TokenType::BinaryOperator) {
+			const int prec = precedence(token);
+			const bool rightAssociative = token.value == '^';
+			while(!operators.empty() ) {
+				const int top = precedence(operators.back() );
+				if(top < prec || (top == prec && rightAssociative) ) {
+					break;
+				}
+				reduce();
+			}
+		}
+		if(operators.size() >= maxDepth) {
+			throw NestingTooDeep();
+		}
+		operators.push_back(token);
+	}
+
+	// Applies what is left on the stacks, ready for the next expression
+	// once it returns
+	Value finish() {
+		while(!operators.empty() ) {
+			reduce();
+		}
+		if(operands.empty() ) {
+			return Value(0);
+		}
+		Value value = std::move(operands.back().value);
+		operands.clear();
+		return value;
+	}
+
+	// Drops what is left of an expression that could not be evaluated
+	void reset() {
+		operands.clear();
+		operators.clear();
+	}
+private:
+	template<typename> friend class StreamReducer;
+
+	struct Operand {
+		Value value;
+		// The integer the operand was written as, a literal exponent is
+		// raised to without converting it to Value
+		std::optional<int64_t> literal;
+	};
+
+	// Applies the operator on top of the stack. The stacks are only changed
+	// once the result is known, if the policy throws they are left as they
+	// were
+	void reduce() {
+		const Token &op = operators.back();
+		if(op.type == TokenType::UnaryOperator) {
+			operands.back() = {Policy::calc(Value(0), operands.back().value, op.value), std::nullopt};
+		} else {
+			const Operand &rhs = operands.back();
+			Operand &lhs = operands[operands.size() - 2];
+			Value value = op.value == '^' && rhs.literal
+				? raise<Policy>(lhs.value, *rhs.literal)
+				: Policy::calc(lhs.value, rhs.value, op.value);
+			lhs = {std::move(value), std::nullopt};
+			operands.pop_back();
+		}
+		operators.pop_back();
+	}
+
+	std::vector<Operand> operands;
+	std::vector<Token> operators;
+	size_t maxDepth;
+};
+
+// Reads fd to its end a block at a time and hands its tokens to sink
+template<typename Sink>
+void streamTokens(int fd, StreamTokenizer &tokenizer, Sink sink) {
+	std::array<char, streamBlockSize> block;
+	for(;;) {
+		const ssize_t got = read(fd, block.data(), block.size() );
+		if(got < 0) {
+			if(errno == EINTR) {
+				continue;
+			}
+			throw std::system_error(errno, std::generic_category(), "read");
+		}
+		if(got == 0) {
+			break;
+		}
+		tokenizer.feed(block.data(), got, sink);
+	}
+	tokenizer.finish(sink);
+}